@@ -0,0 +1,104 @@
+/**
+ * SPDX-License-Identifier: MPL-2.0+
+ * @file alloc_FLST.cpp
+ * @brief Count memory allocations during tree extraction.
+ * @author Pascal Monasse <monasse@imagine.enpc.fr>
+ *
+ * Copyright (c) 2024 Pascal Monasse
+ * All rights reserved.
+ */
+
+#include "libImage/image_io.hpp"
+#include "tree_builder.h"
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+static long nAlloc = 0; ///< Number of calls to operator new
+
+void* operator new(size_t size) {
+    ++nAlloc;
+    void* p = malloc(size? size: 1);
+    if(! p)
+        throw std::bad_alloc();
+    return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) throw() { free(p); }
+void operator delete[](void* p) throw() { free(p); }
+void operator delete(void* p, size_t) throw() { free(p); }
+void operator delete[](void* p, size_t) throw() { free(p); }
+
+/// Extract the tree of \a im and print the number of allocations.
+static void extract(const Image<unsigned char>& im, LsTree::Algo algo,
+                    const LsTree::Options& options, const char* title) {
+    long n = nAlloc;
+    LsTree tree(im.data(), im.Width(), im.Height(), algo, options);
+    n = nAlloc-n;
+    std::cout << title << ": " << n << " allocations, "
+              << (double)n/tree.iNbShapes << " per shape" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if(argc<2 || argc>4) {
+        std::cerr << "Usage: " << argv[0] << " imageFile [algo] [contour]"
+                  << std::endl;
+        std::cerr << "Algo: one of PRE, POST, UF, MAX, MIN, CLASSIC."
+                  << " Default: POST" << std::endl;
+        std::cerr << "Contour: one of NONE, POINTS, CHAIN. Default: NONE"
+                  << std::endl;
+        return 1;
+    }
+    Image<unsigned char> im;
+    if(! libs::ReadImage(argv[1], &im)) {
+        std::cerr << "Error loading image " << argv[1] << std::endl;
+        return 1;
+    }
+    LsTree::Algo algo = LsTree::TD_POST;
+    if(argc>2) {
+        if(argv[2]==std::string("PRE"))
+            algo = LsTree::TD_PRE;
+        else if(argv[2]==std::string("UF"))
+            algo = LsTree::UNION_FIND;
+        else if(argv[2]==std::string("MAX"))
+            algo = LsTree::MAX_TREE;
+        else if(argv[2]==std::string("MIN"))
+            algo = LsTree::MIN_TREE;
+        else if(argv[2]==std::string("CLASSIC"))
+            algo = LsTree::CLASSIC;
+        else if(argv[2]!=std::string("POST")) {
+            std::cerr << "Unknown algo " << argv[2] << std::endl;
+            return 1;
+        }
+    }
+    LsTree::Options options;
+    options.contour = LsTree::NO_CONTOUR;
+    if(argc>3) {
+        if(argv[3]==std::string("POINTS"))
+            options.contour = LsTree::CONTOUR_POINTS;
+        else if(argv[3]==std::string("CHAIN"))
+            options.contour = LsTree::CONTOUR_CHAIN;
+        else if(argv[3]!=std::string("NONE")) {
+            std::cerr << "Unknown contour " << argv[3] << std::endl;
+            return 1;
+        }
+    }
+
+    extract(im, algo, options, "Temporary workspace");
+    LsWorkspace ws;
+    options.workspace = &ws;
+    extract(im, algo, options, "New workspace");
+    extract(im, algo, options, "Reused workspace");
+    std::cout << "Workspace: " << ws.memory()/1024 << "KB" << std::endl;
+
+    options.workspace = 0;
+    LsTreeBuilder builder;
+    builder.build(im.data(), im.Width(), im.Height(), algo, options);
+    long n = nAlloc;
+    const LsTree& tree = builder.build(im.data(), im.Width(), im.Height(),
+                                       algo, options);
+    n = nAlloc-n;
+    std::cout << "Builder, next image: " << n << " allocations, "
+              << (double)n/tree.iNbShapes << " per shape" << std::endl;
+    return 0;
+}
@@ -0,0 +1,124 @@
+/**
+ * SPDX-License-Identifier: MPL-2.0+
+ * @file chain_code.h
+ * @brief Level lines stored as Freeman chain codes
+ * @author Pascal Monasse <monasse@imagine.enpc.fr>
+ *
+ * Copyright (c) 2024 Pascal Monasse
+ * All rights reserved.
+ */
+
+#ifndef CHAIN_CODE_H
+#define CHAIN_CODE_H
+
+#include "shape.h"
+#include <cstddef>
+#include <vector>
+
+/// Walk along the points of a level line stored as a chain code.
+class LsChainIterator {
+public:
+    LsChainIterator(const unsigned char* code, size_t i, LsPoint p)
+    : c(code), k(i), pt(p) {}
+
+    LsPoint operator*() const { return pt; }
+    const LsPoint* operator->() const { return &pt; }
+    bool operator==(const LsChainIterator& it) const { return (k == it.k); }
+    bool operator!=(const LsChainIterator& it) const { return (k != it.k); }
+    LsChainIterator& operator++();
+private:
+    const unsigned char* c; ///< Packed steps
+    size_t k; ///< Index of next step
+    LsPoint pt; ///< Current point
+};
+
+/// Level lines of all shapes as Freeman chain codes, in the order of shapes.
+/// A level line is its first point followed by unit moves in the directions
+/// of edgels: EAST=0 (x+1), NORTH=1 (y-1), WEST=2 (x-1) and SOUTH=3 (y+1).
+/// Moves take 2 bits each and are packed in a single stream, 4 per byte.
+struct LsChainCodes {
+    LsChainCodes(): nSteps(0) {}
+    void clear();
+    void begin_line();
+    void add_step(LsPoint p, unsigned char dir);
+    void end_lines();
+    void append(const LsChainCodes& c, size_t i, size_t j);
+    LsChainIterator begin(int i) const;
+    LsChainIterator end(int i) const;
+    size_t memory() const;
+
+    std::vector<unsigned char> code; ///< Packed moves of all level lines
+    std::vector<size_t> start; ///< Index of first move of each level line
+    std::vector<LsPoint> origin; ///< First point of each level line
+    size_t nSteps; ///< Total number of moves
+};
+
+/// Move to next point.
+inline LsChainIterator& LsChainIterator::operator++() {
+    switch((c[k>>2] >> 2*(k&3)) & 3) {
+    case 0: ++pt.x; break; // EAST
+    case 1: --pt.y; break; // NORTH
+    case 2: --pt.x; break; // WEST
+    case 3: ++pt.y; break; // SOUTH
+    }
+    ++k;
+    return *this;
+}
+
+/// Remove all level lines, keeping the capacity of storage.
+inline void LsChainCodes::clear() {
+    code.clear();
+    start.clear();
+    origin.clear();
+    nSteps = 0;
+}
+
+/// Start a new level line, for the next shape.
+inline void LsChainCodes::begin_line() {
+    start.push_back(nSteps);
+}
+
+/// Add a move along direction \a dir from point \a p. Only the first point
+/// of a level line is stored, the next ones are deduced from the moves.
+inline void LsChainCodes::add_step(LsPoint p, unsigned char dir) {
+    if(origin.size() < start.size())
+        origin.push_back(p);
+    if((nSteps&3) == 0)
+        code.push_back(0);
+    code.back() |= (unsigned char)(dir << 2*(nSteps&3));
+    ++nSteps;
+}
+
+/// Mark the end of the last level line.
+inline void LsChainCodes::end_lines() {
+    start.push_back(nSteps);
+}
+
+/// Append level lines of indices \a i to \a j (excluded) of \a c. The last
+/// level line of \a c may be unfinished (no call to \c end_lines).
+inline void LsChainCodes::append(const LsChainCodes& c, size_t i, size_t j) {
+    for(; i<j; i++) {
+        begin_line();
+        size_t end = (i+1<c.start.size())? c.start[i+1]: c.nSteps;
+        for(size_t k=c.start[i]; k<end; k++)
+            add_step(c.origin[i], (c.code[k>>2] >> 2*(k&3)) & 3);
+    }
+}
+
+/// Iterator on first point of level line of shape of index \a i.
+inline LsChainIterator LsChainCodes::begin(int i) const {
+    return LsChainIterator(code.empty()? 0: &code[0], start[i], origin[i]);
+}
+
+/// Iterator past the end of level line of shape of index \a i.
+inline LsChainIterator LsChainCodes::end(int i) const {
+    return LsChainIterator(code.empty()? 0: &code[0], start[i+1], origin[i]);
+}
+
+/// Memory (in bytes) used by the chain codes.
+inline size_t LsChainCodes::memory() const {
+    return code.capacity() + start.capacity()*sizeof(size_t) +
+        origin.capacity()*sizeof(LsPoint);
+}
+
+#endif
@@ -23,12 +23,277 @@
 
 #include "libImage/image_io.hpp"
 #include "tree.h"
+#include "compact_tree.h"
+#include "shape_arrays.h"
+#include "tree_builder.h"
 #include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <vector>
 
 #define FOLDER "../data/"
 
+// Classical FLST of ClassicalFLST/oldFlst.h, whose type Cimage clashes with
+// the one of edgel.h.
+struct cimage {
+    int nrow, ncol;
+    unsigned char* gray;
+};
+LsTree* ls_new_tree();
+int fllt(int* pMinArea, int* pMaxArea, cimage* pCharImageInput, LsTree* pTree);
+
+/// Smooth waves with noise, giving a deep tree with many shapes.
+static std::vector<unsigned char> waves(int w, int h) {
+    std::vector<unsigned char> im(w*h);
+    srand(0);
+    for(int y=0, i=0; y<h; y++)
+        for(int x=0; x<w; x++, i++)
+            im[i] = (unsigned char)(128 + 100*sin(x*0.1)*cos(y*0.13) +
+                                    rand()%16);
+    return im;
+}
+
+/// Print whether the comparison \a what gives \a same and return it.
+static bool report(const char* what, bool same) {
+    std::cout << what << " (=same): " << (same? "same": "DIFFERENT")
+              << std::endl;
+    return same;
+}
+
+/// Index of shape \a s in \a tree, LsCompactShape::NONE for null pointer.
+static LsCompactShape::Id id(const LsTree& tree, const LsShape* s) {
+    return s? (LsCompactShape::Id)tree.shape_index(s): LsCompactShape::NONE;
+}
+
+/// Compare the compact tree of \a tree, which may be in lazy mode, with \a tree
+/// itself. One shape out of three is ignored to exercise the search of true
+/// family links.
+static bool same_compact(LsTree& tree) {
+    for(int i=1; i<tree.iNbShapes; i++)
+        tree.shape(i)->bIgnore = (i%3 == 0);
+    LsCompactTree c(tree);
+    bool same = (c.nShapes == tree.iNbShapes);
+    unsigned char *a=tree.build_image(), *b=c.build_image();
+    same = same && std::equal(a, a+tree.ncol*tree.nrow, b);
+    delete [] b;
+    std::vector<uint32_t> block(c.data(), c.data()+c.size()); // Relocated
+    LsCompactTree mapped, loaded;
+    same = same && mapped.map(&block[0], block.size()) &&
+        mapped.shapes == (LsCompactShape*)&block[LsCompactTree::HEADER] &&
+        ! mapped.map(&block[0], block.size()-1);
+    b = mapped.build_image();
+    same = same && std::equal(a, a+tree.ncol*tree.nrow, b);
+    delete [] b;
+    same = same && c.save("check_compact.tmp") &&
+        loaded.load("check_compact.tmp") && loaded.size() == c.size() &&
+        std::equal(c.data(), c.data()+c.size(), loaded.data());
+    same = same && LsCompactTree::save(tree, "check_compact.tmp") &&
+        loaded.load("check_compact.tmp") && loaded.size() == c.size() &&
+        std::equal(c.data(), c.data()+c.size(), loaded.data());
+    std::remove("check_compact.tmp");
+    delete [] a;
+    for(int y=0; same && y<tree.nrow; y++)
+        for(int x=0; x<tree.ncol; x++)
+            if(c.smallest_shape(x,y) != id(tree, tree.smallest_shape(x,y)))
+                same = false;
+    for(int i=0; same && i<tree.iNbShapes; i++) {
+        LsShape& s = *tree.shape(i);
+        if(s.bIgnore)
+            continue;
+        same = (c.find_parent(i) == id(tree, s.find_parent()) &&
+                c.find_child(i) == id(tree, s.find_child()) &&
+                c.find_sibling(i) == id(tree, s.find_sibling()) &&
+                c.find_prev_sibling(i) == id(tree, s.find_prev_sibling()));
+    }
+    LsTreeIterator::Order orders[2] = {LsTreeIterator::Pre,
+                                       LsTreeIterator::Post};
+    for(int k=0; same && k<2; k++) {
+        LsTreeIterator it(orders[k], tree.shapes);
+        LsTreeIterator end = LsTreeIterator::end(orders[k], tree.shapes);
+        LsCompactTreeIterator ci(orders[k], c, 0);
+        LsCompactTreeIterator cend = LsCompactTreeIterator::end(orders[k],c,0);
+        for(; same && it!=end && ci!=cend; ++it, ++ci)
+            same = (*ci == id(tree, *it));
+        same = same && it==end && ci==cend;
+    }
+    for(int i=1; i<tree.iNbShapes; i++)
+        tree.shape(i)->bIgnore = false;
+    return same;
+}
+
+/// Points of \a pts, as sorted indices of pixels of width \a w.
+static std::vector<long> sorted(const LsPoint* pts, const LsPoint* end, int w) {
+    std::vector<long> v;
+    for(; pts != end; ++pts)
+        v.push_back((long)pts->y*w + pts->x);
+    std::sort(v.begin(), v.end());
+    return v;
+}
+
+/// Are trees \a a and \a b the same, up to the order of shapes, of their
+/// pixels and of the points of their level lines? The level lines are
+/// compared if \a lines is set, they must then be stored as points. Shapes
+/// are matched through the smallest shape of each pixel, as each shape has
+/// private pixels. The trees may be in lazy mode.
+static bool same_tree(const LsTree& a, const LsTree& b, bool lines) {
+    if(a.ncol!=b.ncol || a.nrow!=b.nrow || a.iNbShapes!=b.iNbShapes)
+        return false;
+    const int n = a.iNbShapes, w = a.ncol;
+    std::vector<int> f(n, -1), g(n, -1); // Matching a->b and b->a
+    for(int i=0; i<a.ncol*a.nrow; i++) {
+        int sa = a.shape_index(a.smallestShape[i]);
+        int sb = b.shape_index(b.smallestShape[i]);
+        if(f[sa] < 0 && g[sb] < 0)
+            f[sa] = sb, g[sb] = sa;
+        else if(f[sa] != sb || g[sb] != sa)
+            return false;
+    }
+    for(int i=0; i<n; i++) {
+        if(f[i] < 0)
+            return false;
+        const LsShape &s = *a.shape(i), &t = *b.shape(f[i]);
+        if(s.type!=t.type || s.gray!=t.gray || s.area!=t.area ||
+           s.bBoundary!=t.bBoundary || (s.parent==0) != (t.parent==0) ||
+           (s.parent && f[a.shape_index(s.parent)]!=b.shape_index(t.parent)))
+            return false;
+        if(sorted(s.pixels, s.pixels+s.area, w) !=
+           sorted(t.pixels, t.pixels+t.area, w))
+            return false;
+        if(lines && sorted(a.contour_begin(&s), a.contour_end(&s), w) !=
+                    sorted(b.contour_begin(&t), b.contour_end(&t), w))
+            return false;
+    }
+    return true;
+}
+
+/// Does \a t have the shapes of \a full that are not ignored, with the same
+/// pixels? They are compared through the ancestors of each pixel.
+static bool same_kept(const LsTree& full, const LsTree& t) {
+    int n = 0;
+    for(int i=0; i<full.iNbShapes; i++)
+        if(! full.shapes[i].bIgnore)
+            ++n;
+    if(n != t.iNbShapes)
+        return false;
+    for(int i=0; i<t.ncol*t.nrow; i++) {
+        const LsShape *a=full.smallestShape[i], *b=t.smallestShape[i];
+        for(;; a=a->parent, b=b->parent) {
+            while(a && a->bIgnore)
+                a = a->parent;
+            if(!a || !b) {
+                if(a || b)
+                    return false;
+                break;
+            }
+            if(a->area!=b->area || a->gray!=b->gray || a->type!=b->type)
+                return false;
+        }
+    }
+    return true;
+}
+
+/// Does extraction by \a algo of image \a gray of size \a w x \a h with the
+/// area range of \a options give its full tree without the shapes out of
+/// range?
+static bool same_pruned(const unsigned char* gray, int w, int h,
+                        LsTree::Algo algo, const LsTree::Options& options) {
+    LsTree full(gray, w, h, algo);
+    int maxArea = (options.maxArea>0)? options.maxArea: w*h;
+    for(int i=1; i<full.iNbShapes; i++) {
+        LsShape& s = full.shapes[i];
+        s.bIgnore = (s.area<options.minArea || s.area>maxArea);
+    }
+    return same_kept(full, LsTree(gray, w, h, algo, options));
+}
+
+/// Mark as ignored the shapes of \a full that are not in \a t, whose shapes
+/// should be shapes of \a full: the shape of \a full of the same area as a
+/// shape of \a t and containing its first pixel.
+static void ignore_missing(LsTree& full, const LsTree& t) {
+    for(int i=0; i<full.iNbShapes; i++)
+        full.shapes[i].bIgnore = true;
+    for(int i=0; i<t.iNbShapes; i++) {
+        const LsShape& s = *t.shape(i);
+        LsShape* f = full.smallestShape[s.pixels[0].y*t.ncol+s.pixels[0].x];
+        while(f && f->area < s.area)
+            f = f->parent;
+        if(f)
+            f->bIgnore = false;
+    }
+}
+
+/// Is \a t the component tree of the upper level sets of \a gray if \a sup,
+/// 8-connected, or of its lower level sets, 4-connected? At each level, the
+/// connected components of the level set are labeled by brute force and
+/// compared to the largest ancestor at that level of the shape of each pixel.
+/// The shapes are the components containing a pixel at the level.
+static bool same_components(const LsTree& t, const unsigned char* gray,
+                            bool sup) {
+    const int w=t.ncol, h=t.nrow, n=w*h, connect=sup? 8: 4;
+    const int dx[8]={1,0,-1,0,1,-1,-1,1}, dy[8]={0,1,0,-1,1,1,-1,-1};
+    std::vector<const LsShape*> cur(t.smallestShape, t.smallestShape+n);
+    std::vector<int> label(n), stack;
+    int nShapes = 0;
+    for(int k=0; k<256; k++) {
+        const int l = sup? 255-k: k; // From the leaves to the root
+        std::fill(label.begin(), label.end(), -1);
+        for(int i=0; i<n; i++) {
+            if(label[i]>=0 || (sup? gray[i]<l: gray[i]>l))
+                continue;
+            int area = 0;
+            bool atLevel = false;
+            const LsShape* s = 0;
+            label[i] = i;
+            stack.assign(1, i);
+            while(! stack.empty()) {
+                int j = stack.back();
+                stack.pop_back();
+                ++area;
+                atLevel = atLevel || gray[j]==l;
+                const LsShape*& c = cur[j];
+                while(c->parent && (sup? c->parent->gray>=l:
+                                         c->parent->gray<=l))
+                    c = c->parent;
+                if(s && c != s)
+                    return false;
+                s = c;
+                for(int d=0; d<connect; d++) {
+                    int x=j%w+dx[d], y=j/w+dy[d], m=y*w+x;
+                    if(0<=x && x<w && 0<=y && y<h && label[m]<0 &&
+                       (sup? gray[m]>=l: gray[m]<=l)) {
+                        label[m] = i;
+                        stack.push_back(m);
+                    }
+                }
+            }
+            if(s->area != area || s->type != (sup? LsShape::SUP: LsShape::INF))
+                return false;
+            if(atLevel)
+                ++nShapes;
+        }
+    }
+    return nShapes == t.iNbShapes;
+}
+
+/// Compare the arrays of attributes of \a tree, which may be in lazy mode,
+/// with its shapes.
+static bool same_arrays(const LsTree& tree) {
+    LsShapeArrays a(tree);
+    bool same = (a.area.size() == (size_t)tree.iNbShapes);
+    for(int i=0; same && i<tree.iNbShapes; i++) {
+        const LsShape& s = *tree.shape(i);
+        same = (a.type[i] == s.type && a.gray[i] == s.gray &&
+                a.area[i] == s.area &&
+                a.parent[i] == id(tree, s.parent) &&
+                a.child[i] == id(tree, s.child) &&
+                a.sibling[i] == id(tree, s.sibling) &&
+                tree.shapes[0].pixels+a.pixels[i] == s.pixels);
+    }
+    return same;
+}
+
 int main() {
     const char* name;
     Image<unsigned char> im;
@@ -161,5 +426,206 @@ int main() {
             std::cout << ' ' << s2->area;
         std::cout << std::endl;
     }
-    return 0;
+
+    const int w=160, h=120;
+    std::vector<unsigned char> gray = waves(w, h);
+    bool ok = true;
+    std::cout << "* waves " << w << 'x' << h << std::endl;
+    {
+        LsTree tree(&gray[0], w, h);
+        ok = report("Compact tree", same_compact(tree)) && ok;
+        ok = report("Arrays of attributes", same_arrays(tree)) && ok;
+
+        LsTreeBuilder builder; // Three images of different sizes, then first
+        std::vector<unsigned char> small = waves(w/2, h/3);
+        builder.build(&gray[0], w, h);
+        builder.build(&small[0], w/2, h/3);
+        bool same = same_tree(builder.tree(), LsTree(&small[0], w/2, h/3),
+                              true);
+        std::vector<unsigned char> big = waves(2*w, h);
+        builder.build(&big[0], 2*w, h);
+        same = same && same_tree(builder.tree(), LsTree(&big[0], 2*w, h), true);
+        same = same && same_tree(builder.build(&gray[0], w, h), tree, true);
+        ok = report("Tree builder", same) && ok;
+    }
+
+    {
+        LsTree pre(&gray[0], w, h);
+        bool same = same_tree(pre, LsTree(&gray[0], w, h, LsTree::TD_POST),
+                              true);
+        ok = report("Top-down in post-order", same) && ok;
+        LsTree uf(&gray[0], w, h, LsTree::UNION_FIND);
+        ok = report("Union-find", same_tree(pre, uf, false)) && ok;
+        // The boundaries of children recorded by TD_PRE in the scan of their
+        // parent (seed lines) against the level lines traced one by one
+        ok = report("Seed lines", same_tree(pre, uf, true)) && ok;
+        same = same_components(LsTree(&gray[0], w, h, LsTree::MAX_TREE),
+                               &gray[0], true);
+        ok = report("Max-tree", same) && ok;
+        same = same_components(LsTree(&gray[0], w, h, LsTree::MIN_TREE),
+                               &gray[0], false);
+        ok = report("Min-tree", same) && ok;
+
+        LsTree::Options options;
+        options.contour = LsTree::NO_CONTOUR;
+        std::vector<unsigned char> copy(gray); // Changed by fllt
+        cimage in = {h, w, &copy[0]};
+        LsTree* old = ls_new_tree();
+        fllt(0, 0, &in, old);
+        LsTree classic(&gray[0], w, h, LsTree::CLASSIC, options);
+        old->shapes[0].type = classic.shapes[0].type; // Any type for root
+        for(int i=0; i<old->iNbShapes; i++) // Set through private pixels
+            old->shapes[i].bBoundary = false;
+        for(int i=0; i<w*h; i++)
+            if(i<w || i>=(h-1)*w || i%w==0 || i%w==w-1)
+                old->smallestShape[i]->bBoundary = true;
+        same = same_tree(classic, *old, false);
+        delete old;
+        ok = report("Classic and old FLST", same) && ok;
+    }
+
+    {
+        LsTree::Options options;
+        options.minArea = 20;
+        options.maxArea = 5000;
+        const LsTree::Algo algos[3] = {LsTree::TD_PRE, LsTree::TD_POST,
+                                       LsTree::CLASSIC};
+        bool same = true;
+        for(int k=0; same && k<3; k++)
+            same = same_pruned(&gray[0], w, h, algos[k], options);
+        // maxArea at the area of shapes, below half the image
+        const unsigned char tiny[15] = {135, 143, 156, 131, 138,
+                                        162, 138, 149, 156, 141,
+                                        147, 157, 130, 147, 148};
+        LsTree::Options small;
+        for(small.maxArea=6; same && small.maxArea<=7; small.maxArea++)
+            for(int k=0; same && k<3; k++)
+                same = same_pruned(tiny, 5, 3, algos[k], small);
+        ok = report("Area range", same) && ok;
+
+        options.maxArea = 0;
+        LsTree tree(&gray[0], w, h, LsTree::TD_PRE, options);
+        unsigned char* a = tree.build_image();
+        std::vector<unsigned char> b(w*h);
+        grain_filter(&gray[0], w, h, options.minArea, &b[0]);
+        same = std::equal(b.begin(), b.end(), a);
+        delete [] a;
+        ok = report("Grain filter", same) && ok;
+    }
+
+    {
+        LsTree::Options options;
+        options.quantum = 16;
+        std::vector<unsigned char> q(gray);
+        for(size_t i=0; i<q.size(); i++)
+            q[i] = (unsigned char)(q[i]/16*16);
+        bool same = same_tree(LsTree(&gray[0], w, h, LsTree::TD_PRE, options),
+                              LsTree(&q[0], w, h), true);
+        options.quantum = 1;
+        const unsigned char levels[] = {60, 100, 101, 180};
+        options.levels.assign(levels, levels+4);
+        for(size_t i=0; i<q.size(); i++)
+            q[i] = (gray[i]<60)? 0: (gray[i]<100)? 60: (gray[i]<101)? 100:
+                (gray[i]<180)? 101: 180;
+        same = same && same_tree(LsTree(&gray[0],w,h,LsTree::TD_PRE,options),
+                                 LsTree(&q[0], w, h), true);
+        ok = report("Quantum and levels", same) && ok;
+    }
+
+    {
+        LsTree::Options options;
+        options.tolerance = 6;
+        LsTree full(&gray[0], w, h);
+        for(int i=1; i<full.iNbShapes; i++) { // Parents before children
+            LsShape& s = full.shapes[i];
+            s.bIgnore = (abs(s.gray - s.find_parent()->gray) <= 6);
+        }
+        LsTree pre(&gray[0], w, h, LsTree::TD_PRE, options);
+        bool same = same_kept(full, pre);
+        same = same && same_tree(pre, LsTree(&gray[0], w, h, LsTree::TD_POST,
+                                             options), true);
+        ok = report("Tolerance", same) && ok;
+    }
+
+    {
+        LsTree::Options options;
+        options.maxShapes = 50;
+        LsTree full(&gray[0], w, h);
+        LsTree tree(&gray[0], w, h, LsTree::TD_PRE, options);
+        bool same = (tree.iNbShapes == 50 && !tree.complete());
+        options.maxShapes = 1000;
+        for(int n=0; same && !tree.complete() && n<full.iNbShapes; n++) {
+            ignore_missing(full, tree);
+            same = same_kept(full, tree);
+            tree.refine(&gray[0], options);
+        }
+        for(int i=0; i<full.iNbShapes; i++)
+            full.shapes[i].bIgnore = false;
+        same = same && tree.complete() && same_tree(full, tree, true);
+        ok = report("Budget and refinement", same) && ok;
+    }
+
+    {
+        LsTree::Options options;
+        options.lazy = true;
+        LsTree full(&gray[0], w, h);
+        LsTree tree(&gray[0], w, h, LsTree::TD_PRE, options);
+        LsShape* root = tree.shapes;
+        LsShape* s = tree.smallest_shape(w/2, h/2);
+        const LsShape* f = full.smallestShape[h/2*w+w/2];
+        bool same = (tree.shapes == root && !tree.complete() &&
+                     s->gray == f->gray && s->area == f->area);
+        ignore_missing(full, tree);
+        same = same && same_kept(full, tree);
+        LsTree refined(&gray[0], w, h, LsTree::TD_PRE, options);
+        refined.smallest_shape(w/2, h/2);
+        refined.refine(&gray[0]); // Leaves lazy mode
+        for(int y=0; y<h; y++) // Develop all
+            for(int x=0; x<w; x++)
+                tree.smallest_shape(x, y);
+        for(int i=0; i<full.iNbShapes; i++)
+            full.shapes[i].bIgnore = false;
+        same = same && tree.shapes == root && tree.complete() &&
+            same_tree(full, tree, true) && refined.complete() &&
+            same_tree(full, refined, true) && same_arrays(tree) &&
+            same_compact(tree);
+        LsTree walked(&gray[0], w, h, LsTree::TD_PRE, options);
+        int n = 0; // Iterators develop the shapes they reach
+        LsTreeIterator it(LsTreeIterator::Post, walked, walked.shapes);
+        LsTreeIterator end = LsTreeIterator::end(LsTreeIterator::Post, walked,
+                                                 walked.shapes);
+        for(; it!=end; ++it)
+            ++n;
+        same = same && n == full.iNbShapes && walked.complete() &&
+            same_tree(full, walked, true);
+        ok = report("Lazy extraction", same) && ok;
+    }
+
+    {
+        LsTree::Options options;
+        options.padded = true;
+        LsTree plain(&gray[0], w, h);
+        bool same = same_tree(plain, LsTree(&gray[0], w, h, LsTree::TD_PRE,
+                                            options), true);
+        ok = report("Padded image", same) && ok;
+    }
+
+    {
+        LsTree::Options options;
+        options.runs = true;
+        LsTree plain(&gray[0], w, h);
+        bool same = same_tree(plain, LsTree(&gray[0], w, h, LsTree::TD_PRE,
+                                            options), true);
+        options.padded = true;
+        same = same && same_tree(plain, LsTree(&gray[0], w, h, LsTree::TD_PRE,
+                                               options), true);
+        options.quantum = 32; // Flat zones, long runs
+        options.runs = options.padded = false;
+        LsTree flat(&gray[0], w, h, LsTree::TD_PRE, options);
+        options.runs = true;
+        same = same && same_tree(flat, LsTree(&gray[0], w, h, LsTree::TD_PRE,
+                                              options), true);
+        ok = report("Runs", same) && ok;
+    }
+    return ok? 0: 1;
 }
@@ -0,0 +1,142 @@
+/**
+ * SPDX-License-Identifier: MPL-2.0+
+ * @file compact_FLST.cpp
+ * @brief Memory and speed of the compact tree and of the arrays of attributes
+ * compared to the regular tree.
+ * @author Pascal Monasse <monasse@imagine.enpc.fr>
+ *
+ * Copyright (c) 2024 Pascal Monasse
+ * All rights reserved.
+ */
+
+#include "compact_tree.h"
+#include "shape_arrays.h"
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <vector>
+
+/// Uniform noise.
+static void noise(unsigned char* im, int w, int h) {
+    srand(0);
+    for(int i=w*h; i>0; i--)
+        *im++ = (unsigned char)(rand()%256);
+}
+
+/// Sum of areas of shapes of \a tree in order \a o.
+static long walk(LsTree& tree, LsTreeIterator::Order o) {
+    long sum = 0;
+    LsTreeIterator it(o, tree.shapes);
+    LsTreeIterator end = LsTreeIterator::end(o, tree.shapes);
+    for(; it != end; ++it)
+        sum += (*it)->area;
+    return sum;
+}
+
+/// Sum of areas of shapes of compact tree \a tree in order \a o.
+static long walk(const LsCompactTree& tree, LsTreeIterator::Order o) {
+    long sum = 0;
+    LsCompactTreeIterator it(o, tree, 0);
+    LsCompactTreeIterator end = LsCompactTreeIterator::end(o, tree, 0);
+    for(; it != end; ++it)
+        sum += tree.shapes[*it].area;
+    return sum;
+}
+
+/// Scan of area, gray level and parent of all shapes: total area of shapes
+/// brighter than their parent.
+static long scan(const LsTree& tree) {
+    long sum = 0;
+    for(int i=1; i<tree.iNbShapes; i++) {
+        const LsShape& s = tree.shapes[i];
+        if(s.gray > s.parent->gray)
+            sum += s.area;
+    }
+    return sum;
+}
+
+/// Same scan as above in the arrays of attributes \a a.
+static long scan(const LsShapeArrays& a) {
+    long sum = 0;
+    for(size_t i=1; i<a.area.size(); i++)
+        if(a.gray[i] > a.gray[a.parent[i]])
+            sum += a.area[i];
+    return sum;
+}
+
+/// Reconstruct the image of \a tree, return the sum of its gray levels.
+template <class Tree>
+static long image(const Tree& tree, int n) {
+    unsigned char* im = tree.build_image();
+    long sum = 0;
+    for(int i=0; i<n; i++)
+        sum += im[i];
+    delete [] im;
+    return sum;
+}
+
+/// Elapsed time since \a t in seconds.
+static double seconds(clock_t t) {
+    return (double)(clock()-t)/CLOCKS_PER_SEC;
+}
+
+int main(int argc, char* argv[]) {
+    if(argc>2) {
+        std::cerr << "Usage: " << argv[0] << " [size]" << std::endl;
+        std::cerr << "Size: side of square noise image. Default: 1500"
+                  << std::endl;
+        return 1;
+    }
+    int n = (argc>1)? atoi(argv[1]): 1500;
+    if(n<2 || n>32767) {
+        std::cerr << "Size should be in [2,32767]" << std::endl;
+        return 1;
+    }
+
+    std::vector<unsigned char> im((size_t)n*n);
+    noise(&im[0], n, n);
+    LsTree::Options options;
+    options.contour = LsTree::NO_CONTOUR;
+    LsTree tree(&im[0], n, n, LsTree::TD_PRE, options);
+    clock_t t = clock();
+    LsCompactTree compact(tree);
+    double tBuild = seconds(t);
+    LsShapeArrays arrays(tree);
+    std::cout << "Shapes: " << tree.iNbShapes << " Conversion: " << tBuild
+              << "s" << std::endl;
+    std::cout << "Memory: tree " << tree.memory()/1e6 << "MB, compact tree "
+              << compact.memory()/1e6 << "MB, both during conversion "
+              << (tree.memory()+compact.memory())/1e6 << "MB, arrays "
+              << arrays.memory()/1e6 << "MB" << std::endl;
+
+    const int N = 8; // Pairs of tasks, which should give the same sum
+    const char* tasks[N] = {"Walk pre-order", "Walk pre-order compact",
+                            "Walk post-order", "Walk post-order compact",
+                            "Image", "Image compact", "Scan", "Scan arrays"};
+    const LsTreeIterator::Order pre=LsTreeIterator::Pre,post=LsTreeIterator::Post;
+    double time[N] = {};
+    long sum[N] = {};
+    for(int k=0; k<5*N; k++) { // Best of 5 runs, alternating
+        int m = k%N;
+        t = clock();
+        switch(m) {
+        case 0: sum[m] = walk(tree, pre); break;
+        case 1: sum[m] = walk(compact, pre); break;
+        case 2: sum[m] = walk(tree, post); break;
+        case 3: sum[m] = walk(compact, post); break;
+        case 4: sum[m] = image(tree, n*n); break;
+        case 5: sum[m] = image(compact, n*n); break;
+        case 6: sum[m] = scan(tree); break;
+        case 7: sum[m] = scan(arrays); break;
+        }
+        double dt = seconds(t);
+        if(k<N || dt<time[m])
+            time[m] = dt;
+    }
+    for(int m=0; m<N; m++)
+        std::cout << tasks[m] << ": " << time[m] << "s" << std::endl;
+    for(int m=0; m<N; m+=2)
+        if(sum[m+1] != sum[m])
+            std::cout << tasks[m+1] << ": DIFFERENT" << std::endl;
+    return 0;
+}
@@ -0,0 +1,286 @@
+/**
+ * SPDX-License-Identifier: MPL-2.0+
+ * @file compact_tree.cpp
+ * @brief Tree of shapes with 32-bit indices instead of pointers
+ * @author Pascal Monasse <monasse@imagine.enpc.fr>
+ *
+ * Copyright (c) 2024 Pascal Monasse
+ * All rights reserved.
+ */
+
+#include "compact_tree.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+const LsCompactShape::Id LsCompactShape::NONE;
+const uint32_t LsCompactTree::MAGIC;
+const size_t LsCompactTree::HEADER;
+
+/// Index of shape \a s in \a tree, NONE for null pointer.
+static LsCompactShape::Id id(const LsTree& tree, const LsShape* s) {
+    return s? (LsCompactShape::Id)tree.shape_index(s): LsCompactShape::NONE;
+}
+
+/// Compact shape of shape \a s of \a tree, whose pixels start at \a p.
+static LsCompactShape convert(const LsTree& tree, const LsShape& s,
+                              const LsPoint* p) {
+    LsCompactShape c;
+    c.type = s.type;
+    c.gray = s.gray;
+    c.bIgnore = s.bIgnore;
+    c.bBoundary = s.bBoundary;
+    c.area = s.area;
+    c.pixels = p? (uint32_t)(s.pixels-p): 0;
+    c.parent = id(tree, s.parent);
+    c.sibling = id(tree, s.sibling);
+    c.child = id(tree, s.child);
+    return c;
+}
+
+/// Number of words of the block of a tree of \a nShapes shapes in an image
+/// of size \a ncol x \a nrow.
+size_t LsCompactTree::block_size(int ncol, int nrow, int nShapes) {
+    return HEADER + (size_t)nShapes*(sizeof(LsCompactShape)/sizeof(uint32_t))
+        + (size_t)ncol*nrow*(1 + sizeof(LsPoint)/sizeof(uint32_t));
+}
+
+/// Constructor of an empty tree, to be filled by \c map or \c load.
+LsCompactTree::LsCompactTree()
+: ncol(0), nrow(0), nShapes(0), shapes(0), pixels(0), smallestShape(0),
+  words(0), nWords(0) {}
+
+/// Constructor, converting a regular tree, which may be in lazy mode.
+LsCompactTree::LsCompactTree(const LsTree& tree)
+: block(block_size(tree.ncol, tree.nrow, tree.iNbShapes)) {
+    block[0] = MAGIC;
+    block[1] = (uint32_t)tree.ncol;
+    block[2] = (uint32_t)tree.nrow;
+    block[3] = (uint32_t)tree.iNbShapes;
+    set_block(&block[0], block.size());
+    const LsPoint* p = (tree.iNbShapes>0)? tree.shapes[0].pixels: 0;
+    if(p)
+        std::copy(p, p+ncol*nrow, pixels);
+    for(int i=0; i<tree.iNbShapes; i++)
+        shapes[i] = convert(tree, *tree.shape(i), p);
+    for(int i=ncol*nrow-1; i>=0; i--)
+        smallestShape[i] = id(tree, tree.smallestShape[i]);
+}
+
+/// Point the arrays inside \a b of \a size words, whose header is valid.
+void LsCompactTree::set_block(uint32_t* b, size_t size) {
+    words = b;
+    nWords = size;
+    ncol = (int)b[1];
+    nrow = (int)b[2];
+    nShapes = (int)b[3];
+    shapes = reinterpret_cast<LsCompactShape*>(b+HEADER);
+    smallestShape = reinterpret_cast<Id*>(shapes+nShapes);
+    pixels = reinterpret_cast<LsPoint*>(smallestShape+ncol*nrow);
+}
+
+/// Use in place the block \a b of \a size words, without copy, for example
+/// a file written by \c save and mapped in memory. The block must remain
+/// valid while the tree is used. Only the header is checked: return \c false
+/// if it is not the one of a compact tree of this size.
+bool LsCompactTree::map(uint32_t* b, size_t size) {
+    if(size<HEADER || b[0]!=MAGIC || b[1]>32767 || b[2]>32767 ||
+       b[3] > b[1]*b[2] || size != block_size((int)b[1],(int)b[2],(int)b[3]))
+        return false;
+    std::vector<uint32_t>().swap(block);
+    set_block(b, size);
+    return true;
+}
+
+/// Read the tree in file \a fileName, written by \c save.
+/// Return \c false if the file cannot be read or is not a compact tree.
+bool LsCompactTree::load(const char* fileName) {
+    FILE* file = fopen(fileName, "rb");
+    if(! file)
+        return false;
+    std::vector<uint32_t> b(HEADER);
+    bool ok = (fread(&b[0], sizeof(uint32_t), HEADER, file) == HEADER &&
+               b[0] == MAGIC && b[1] <= 32767 && b[2] <= 32767 &&
+               b[3] <= b[1]*b[2]);
+    if(ok) {
+        b.resize(block_size((int)b[1], (int)b[2], (int)b[3]));
+        size_t n = b.size()-HEADER;
+        ok = (fread(&b[HEADER], sizeof(uint32_t), n, file) == n &&
+              fgetc(file) == EOF);
+    }
+    fclose(file);
+    if(ok) {
+        block.swap(b);
+        set_block(&block[0], block.size());
+    }
+    return ok;
+}
+
+/// Write the block of the tree in file \a fileName.
+bool LsCompactTree::save(const char* fileName) const {
+    FILE* file = fopen(fileName, "wb");
+    if(! file)
+        return false;
+    bool ok = (fwrite(words, sizeof(uint32_t), nWords, file) == nWords);
+    return (fclose(file) == 0) && ok;
+}
+
+/// Write in file \a fileName the compact tree of \a tree, as \c save does,
+/// without building it in memory: \c load or \c map of the file give the
+/// compact tree without the peak of memory of the conversion.
+bool LsCompactTree::save(const LsTree& tree, const char* fileName) {
+    FILE* file = fopen(fileName, "wb");
+    if(! file)
+        return false;
+    const int n = tree.ncol*tree.nrow, BUFFER = 4096;
+    uint32_t header[HEADER] = {MAGIC, (uint32_t)tree.ncol, (uint32_t)tree.nrow,
+                               (uint32_t)tree.iNbShapes};
+    bool ok = (fwrite(header, sizeof(uint32_t), HEADER, file) == HEADER);
+    const LsPoint* p = (tree.iNbShapes>0)? tree.shapes[0].pixels: 0;
+    std::vector<LsCompactShape> shapes(BUFFER);
+    for(int i=0; ok && i<tree.iNbShapes; i+=BUFFER) {
+        int m = std::min(BUFFER, tree.iNbShapes-i);
+        for(int j=0; j<m; j++)
+            shapes[j] = convert(tree, *tree.shape(i+j), p);
+        ok = (fwrite(&shapes[0], sizeof(LsCompactShape), m, file) == (size_t)m);
+    }
+    std::vector<Id> ids(BUFFER);
+    for(int i=0; ok && i<n; i+=BUFFER) {
+        int m = std::min(BUFFER, n-i);
+        for(int j=0; j<m; j++)
+            ids[j] = id(tree, tree.smallestShape[i+j]);
+        ok = (fwrite(&ids[0], sizeof(Id), m, file) == (size_t)m);
+    }
+    if(ok && p)
+        ok = (fwrite(p, sizeof(LsPoint), n, file) == (size_t)n);
+    return (fclose(file) == 0) && ok;
+}
+
+/// The block of the tree, of \c size words.
+const uint32_t* LsCompactTree::data() const {
+    return words;
+}
+
+/// Number of words of the block of the tree.
+size_t LsCompactTree::size() const {
+    return nWords;
+}
+
+/// Reconstruct an image from the tree
+unsigned char* LsCompactTree::build_image() const {
+    unsigned char* gray = new unsigned char[nrow*ncol];
+    unsigned char* out = gray;
+    const LsCompactShape* s = shapes;
+    const Id* pId = smallestShape;
+    for(int i = nrow*ncol-1; i >= 0; i--) {
+        const LsCompactShape* sh = s + *pId++;
+        while(sh->bIgnore)
+            sh = s + sh->parent;
+        *out++ = sh->gray;
+    }
+    return gray;
+}
+
+/// Smallest non-removed shape at pixel (\a x,\a y).
+LsCompactTree::Id LsCompactTree::smallest_shape(int x, int y) const {
+    Id s = smallestShape[y*ncol + x];
+    if(shapes[s].bIgnore)
+        s = find_parent(s);
+    return s;
+}
+
+/// Memory (in bytes) used by the tree.
+size_t LsCompactTree::memory() const {
+    return nWords*sizeof(uint32_t);
+}
+
+/// Return in the subtree of root \a s a shape that is not removed.
+/// The subtree is walked in pre-order without recursion.
+LsCompactTree::Id LsCompactTree::shape_of_subtree(Id s) const {
+    if(s == LsCompactShape::NONE || ! shapes[s].bIgnore)
+        return s;
+    const LsCompactShape* sh = shapes;
+    Id root = s;
+    s = sh[s].child;
+    while(s != LsCompactShape::NONE) {
+        if(! sh[s].bIgnore)
+            return s;
+        if(sh[s].child != LsCompactShape::NONE) {
+            s = sh[s].child;
+            continue;
+        }
+        while(s != root && sh[s].sibling == LsCompactShape::NONE)
+            s = sh[s].parent;
+        if(s == root)
+            break;
+        s = sh[s].sibling;
+    }
+    return LsCompactShape::NONE;
+}
+
+/// Greatest non removed ancestor of \a s, or itself, \a s being removed.
+LsCompactTree::Id LsCompactTree::kept_parent(Id s) const {
+    while(s != LsCompactShape::NONE && shapes[s].bIgnore)
+        s = shapes[s].parent;
+    return s;
+}
+
+/// First non removed shape in the subtrees of \a c and its next siblings,
+/// \a c being removed. See LsShape::find_child.
+LsCompactTree::Id LsCompactTree::kept_child(Id c) const {
+    const LsCompactShape* sh = shapes;
+    Id notRemoved = LsCompactShape::NONE;
+    for(Id s = c; s != LsCompactShape::NONE; s = sh[s].sibling)
+        if(! sh[s].bIgnore || // Avoid function call in common case
+           (notRemoved = shape_of_subtree(s)) != LsCompactShape::NONE)
+            return sh[s].bIgnore? notRemoved: s;
+    return notRemoved;
+}
+
+/// Find next sibling of \a s when it is not the next shape in the array of
+/// siblings. See LsShape::find_sibling.
+LsCompactTree::Id LsCompactTree::kept_sibling(Id s) const {
+    const LsCompactShape* sh = shapes;
+    Id s2 = LsCompactShape::NONE;
+    for(;; s = sh[s].parent) {
+        // First look at the siblings in the original tree
+        for(Id s1=sh[s].sibling; s1!=LsCompactShape::NONE; s1=sh[s1].sibling)
+            if(! sh[s1].bIgnore)
+                return s1;
+            else if((s2 = shape_of_subtree(s1)) != LsCompactShape::NONE)
+                return s2;
+        Id p = sh[s].parent;
+        if(p == LsCompactShape::NONE || ! sh[p].bIgnore)
+            return LsCompactShape::NONE; // Parent is also parent in true tree
+    }
+}
+
+/// Beware: undefined behavior if the shape is removed (field \c bIgnore).
+LsCompactTree::Id LsCompactTree::find_prev_sibling(Id s) const {
+    assert(! shapes[s].bIgnore);
+    Id next = find_parent(s);
+    if(next == LsCompactShape::NONE)
+        return next;
+    next = find_child(next);
+    Id prev = LsCompactShape::NONE;
+    while(next != s) {
+        prev = next;
+        next = find_sibling(prev);
+    }
+    return prev;
+}
+
+LsCompactTreeIterator
+LsCompactTreeIterator::end(Order ord, const LsCompactTree& tree, Id s) {
+    LsCompactTreeIterator it;
+    it.t = &tree;
+    it.s = s;
+    it.o = ord;
+    if(s != LsCompactShape::NONE && ! tree.shapes[s].bIgnore) {
+        if(ord == LsTreeIterator::Pre)
+            it.s = it.uncle(s);
+        else // (ord == Post)
+            ++it;
+    }
+    return it;
+}
@@ -0,0 +1,198 @@
+/**
+ * SPDX-License-Identifier: MPL-2.0+
+ * @file compact_tree.h
+ * @brief Tree of shapes with 32-bit indices instead of pointers
+ * @author Pascal Monasse <monasse@imagine.enpc.fr>
+ *
+ * Copyright (c) 2024 Pascal Monasse
+ * All rights reserved.
+ */
+
+#ifndef COMPACT_TREE_H
+#define COMPACT_TREE_H
+
+#include "tree.h"
+#include <stdint.h>
+
+/// Shape of a compact tree. Family links are indices of shapes.
+struct LsCompactShape {
+    typedef uint32_t Id;
+    static const Id NONE = 0xffffffff; ///< Index of no shape
+
+    LsShape::Type type; ///< Inf or sup level set
+    unsigned char gray; ///< Gray level of the level set
+    bool bIgnore; ///< Should the shape be ignored?
+    bool bBoundary; ///< Does the shape meet the border of the image?
+
+    int area; ///< Number of pixels in the shape
+    uint32_t pixels; ///< Index of first pixel in LsCompactTree::pixels
+
+    // Tree structure
+    Id parent;  ///< Smallest containing shape
+    Id sibling; ///< Siblings are linked
+    Id child;   ///< First child
+};
+
+/// Tree of shapes where shapes are referred to by their 32-bit index.
+/// The whole tree is a single block of 32-bit words: a header (see
+/// \c HEADER), the shapes, the index of the smallest shape of each pixel and
+/// the pixels of shapes. There is no pointer inside the block, so that it can
+/// be copied, written to a file by \c save and read back by \c load, or
+/// mapped in memory (for example by \c mmap of such a file) and used in place
+/// by \c map. The file format is the one of the memory, so it is portable
+/// only between machines of same endianness and layout of LsCompactShape.
+/// The index of the shape containing each pixel takes half the memory of
+/// LsTree::smallestShape. The compact tree is converted from a regular tree,
+/// so that both are in memory during the conversion; the saving comes once
+/// the LsTree is freed. The static \c save writes the compact tree of an
+/// LsTree without building it, so that \c load or \c map of the file avoid
+/// this peak of memory.
+struct LsCompactTree {
+    typedef LsCompactShape::Id Id;
+    static const uint32_t MAGIC = 0x5443534c; ///< "LSCT" in little endian
+    static const size_t HEADER = 4; ///< Words: magic, ncol, nrow, nShapes
+
+    LsCompactTree();
+    explicit LsCompactTree(const LsTree& tree);
+
+    bool map(uint32_t* block, size_t size);
+    bool load(const char* fileName);
+    bool save(const char* fileName) const;
+    static bool save(const LsTree& tree, const char* fileName);
+    const uint32_t* data() const;
+    size_t size() const;
+    static size_t block_size(int ncol, int nrow, int nShapes);
+
+    unsigned char* build_image() const;
+    Id smallest_shape(int x, int y) const;
+    size_t memory() const;
+
+    // To move in the tree, taking into account that some shapes are ignored
+    Id find_parent(Id s) const;
+    Id find_child(Id s) const;
+    Id find_sibling(Id s) const;
+    Id find_prev_sibling(Id s) const;
+
+    int ncol, nrow; ///< Dimensions of image
+    int nShapes; ///< Number of shapes
+    LsCompactShape* shapes; ///< The array of shapes, root first
+    LsPoint* pixels; ///< Pixels of shapes
+
+    /// For each pixel, the index of the smallest shape containing it
+    Id* smallestShape;
+private:
+    std::vector<uint32_t> block; ///< Storage, empty when the block is mapped
+    uint32_t* words; ///< The block, in \c block or mapped
+    size_t nWords; ///< Size of the block in words
+
+    LsCompactTree(const LsCompactTree&); // Not copyable, the arrays would
+    LsCompactTree& operator=(const LsCompactTree&); // be shared
+    void set_block(uint32_t* block, size_t size);
+    Id shape_of_subtree(Id s) const;
+    Id kept_parent(Id s) const;
+    Id kept_child(Id c) const;
+    Id kept_sibling(Id s) const;
+};
+
+/// To walk the compact tree in pre- or post-order
+class LsCompactTreeIterator {
+public:
+    typedef LsCompactTree::Id Id;
+    typedef LsTreeIterator::Order Order;
+    LsCompactTreeIterator();
+    LsCompactTreeIterator(Order ord, const LsCompactTree& tree, Id shape);
+
+    Id operator*() const;
+    bool operator==(const LsCompactTreeIterator& it) const;
+    bool operator!=(const LsCompactTreeIterator& it) const;
+    LsCompactTreeIterator& operator++();
+    static LsCompactTreeIterator end(Order ord, const LsCompactTree& tree,
+                                     Id shape);
+private:
+    Id go_bottom(Id shape) const;
+    Id uncle(Id shape) const;
+    const LsCompactTree* t;
+    Id s;
+    Order o;
+};
+
+inline LsCompactTreeIterator::LsCompactTreeIterator()
+: t(0), s(LsCompactShape::NONE), o(LsTreeIterator::Pre) {}
+
+inline LsCompactTreeIterator::LsCompactTreeIterator(Order ord,
+                                                    const LsCompactTree& tree,
+                                                    Id shape)
+: t(&tree), s(shape), o(ord) {
+    if(ord == LsTreeIterator::Post && s != LsCompactShape::NONE &&
+       ! t->shapes[s].bIgnore)
+        s = go_bottom(s);
+}
+
+/// Greatest non removed ancestor of \a s. The common cases are inline, the
+/// others are in LsCompactTree::kept_parent. Same for the other links.
+inline LsCompactTree::Id LsCompactTree::find_parent(Id s) const {
+    Id p = shapes[s].parent;
+    return (p == LsCompactShape::NONE || ! shapes[p].bIgnore)? p:
+        kept_parent(p);
+}
+
+/// First child, taking into account that some shapes are removed.
+inline LsCompactTree::Id LsCompactTree::find_child(Id s) const {
+    Id c = shapes[s].child;
+    return (c == LsCompactShape::NONE || ! shapes[c].bIgnore)? c:
+        kept_child(c);
+}
+
+/// Next sibling, taking into account that some shapes are removed.
+inline LsCompactTree::Id LsCompactTree::find_sibling(Id s) const {
+    const LsCompactShape& sh = shapes[s];
+    if(sh.sibling != LsCompactShape::NONE) {
+        if(! shapes[sh.sibling].bIgnore)
+            return sh.sibling;
+    } else if(sh.parent == LsCompactShape::NONE ||
+              ! shapes[sh.parent].bIgnore)
+        return LsCompactShape::NONE;
+    return kept_sibling(s);
+}
+
+inline bool
+LsCompactTreeIterator::operator==(const LsCompactTreeIterator& it) const
+{ return (s == it.s); }
+
+inline bool
+LsCompactTreeIterator::operator!=(const LsCompactTreeIterator& it) const
+{ return !(*this == it); }
+
+inline LsCompactTreeIterator::Id LsCompactTreeIterator::operator*() const
+{ return s; }
+
+/// Deepest first descendant of \a s, the first shape of its subtree in
+/// post-order.
+inline LsCompactTree::Id LsCompactTreeIterator::go_bottom(Id s) const {
+    for(Id c = t->find_child(s); c != LsCompactShape::NONE; c=t->find_child(s))
+        s = c;
+    return s;
+}
+
+/// Next shape in pre-order after the subtree of \a s.
+inline LsCompactTree::Id LsCompactTreeIterator::uncle(Id s) const {
+    Id sNew;
+    while((sNew = t->find_sibling(s)) == LsCompactShape::NONE)
+        if((s = t->find_parent(s)) == LsCompactShape::NONE)
+            break;
+    return sNew;
+}
+
+/// Next shape in the order of the iterator.
+inline LsCompactTreeIterator& LsCompactTreeIterator::operator++() {
+    if(o == LsTreeIterator::Pre) {
+        Id sNew = t->find_child(s);
+        s = (sNew == LsCompactShape::NONE)? uncle(s): sNew;
+    } else { // (o == Post)
+        Id sNew = t->find_sibling(s);
+        s = (sNew == LsCompactShape::NONE)? t->find_parent(s): go_bottom(sNew);
+    }
+    return *this;
+}
+
+#endif
@@ -0,0 +1,42 @@
+/**
+ * SPDX-License-Identifier: MPL-2.0+
+ * @file contour.h
+ * @brief Storage of level lines during boundary tracing
+ * @author Pascal Monasse <monasse@imagine.enpc.fr>
+ *
+ * Copyright (c) 2024 Pascal Monasse
+ * All rights reserved.
+ */
+
+#ifndef CONTOUR_H
+#define CONTOUR_H
+
+#include "edgel.h"
+#include "tree.h"
+#include "workspace.h"
+
+/// Start the level line of the last shape of \a tree.
+/// Template parameter \a C is a combination of LsTree::Contour flags, known
+/// at compile time so that nothing remains when level lines are not stored.
+/// Type \a T is LsTree or any storage with the same fields for level lines.
+template <int C, class T>
+inline void begin_contour(T& tree) {
+    if(C & LsTree::CONTOUR_POINTS)
+        tree.contourStart.push_back(tree.contours.size());
+    if(C & LsTree::CONTOUR_CHAIN)
+        tree.chains.begin_line();
+}
+
+/// Append edgel \a e to the level line of the last shape of \a tree.
+template <int C, class T>
+inline void add_contour(T& tree, const Edgel& e) {
+    if(C != LsTree::NO_CONTOUR && e.dir < DIAGONAL) {
+        LsPoint p = e.origin();
+        if(C & LsTree::CONTOUR_POINTS)
+            tree.contours.push_back(p);
+        if(C & LsTree::CONTOUR_CHAIN)
+            tree.chains.add_step(p, e.dir);
+    }
+}
+
+#endif
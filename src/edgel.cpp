@@ -9,6 +9,7 @@
  */
 
 #include "edgel.h"
+#include <algorithm>
 
 /// Make a 180 turn compared to direction \a dir.
 static DirEdgel turn_180(DirEdgel dir) {
@@ -94,9 +95,120 @@ void Edgel::turn_right(int connect) {
     }
 }
 
-/// Move to next edgel along the level line.
-void Edgel::next(Cimage im, LsShape::Type type, int level) {
-    int connect = connectivity(type);
+/// Move of the interior pixel along a straight direction.
+static const signed char DX[4] = {1, 0,-1, 0}, DY[4] = {0,-1, 0, 1};
+/// From the pixel ahead, move to the exterior side of a straight direction.
+static const signed char EX[4] = {0, 1, 0,-1}, EY[4] = {1, 0,-1, 0};
+
+/// Move to next edgel along the level line, the level set of type \a t
+/// being in its connectivity. Same as the other \c next, but the type being
+/// fixed for a whole level line, the comparisons and the connectivity are
+/// resolved at compile time. It is instantiated for both types.
+template <LsShape::Type t>
+void Edgel::next(Cimage im, int level) {
+    const int connect = (t==LsShape::INF)? 4: 8;
+    if(dir >= DIAGONAL) {
+        finish_turn(im, connect);
+        return;
+    }
+    const unsigned w=(unsigned)im->ncol, h=(unsigned)im->nrow;
+    int x=pt.x+DX[dir], y=pt.y+DY[dir]; // Pixel ahead, interior side
+    int xr=x+EX[dir], yr=y+EY[dir]; // Pixel ahead, exterior side
+    bool bLeftIn = ((unsigned)x<w && (unsigned)y<h), bRightIn = false;
+    if(bLeftIn) {
+        bLeftIn = compare<t>(im->gray[y*(int)w+x], level);
+        if((connect==8 || bLeftIn) && (unsigned)xr<w && (unsigned)yr<h)
+            bRightIn = compare<t>(im->gray[yr*(int)w+xr], level);
+    }
+    if(bLeftIn && ! bRightIn) { // Go straight
+        pt.x = (short int)x;
+        pt.y = (short int)y;
+    } else if(! bLeftIn && (! bRightIn || connect == 4))
+        turn_left(connect);
+    else {
+        pt.x = (short int)((connect==4)? x: xr);
+        pt.y = (short int)((connect==4)? y: yr);
+        turn_right(connect);
+    }
+}
+
+template void Edgel::next<LsShape::INF>(Cimage im, int level);
+template void Edgel::next<LsShape::SUP>(Cimage im, int level);
+
+/// Same as \c next<t> in padded image \a im, where the pixels ahead always
+/// exist, the frame being outside the level set. The level is not negative.
+template <LsShape::Type t>
+void Edgel::next_padded(Cimage im, int level) {
+    const int connect = (t==LsShape::INF)? 4: 8;
+    if(dir >= DIAGONAL) {
+        finish_turn(im, connect);
+        return;
+    }
+    assert(im->padded && level >= 0);
+    const unsigned char* g = padded_gray(im, t);
+    int x=pt.x+DX[dir], y=pt.y+DY[dir]; // Pixel ahead, interior side
+    int xr=x+EX[dir], yr=y+EY[dir]; // Pixel ahead, exterior side
+    bool bLeftIn = compare<t>(g[y*im->ncol+x], level), bRightIn = false;
+    if(connect==8 || bLeftIn)
+        bRightIn = compare<t>(g[yr*im->ncol+xr], level);
+    if(bLeftIn && ! bRightIn) { // Go straight
+        pt.x = (short int)x;
+        pt.y = (short int)y;
+    } else if(! bLeftIn && (! bRightIn || connect == 4))
+        turn_left(connect);
+    else {
+        pt.x = (short int)((connect==4)? x: xr);
+        pt.y = (short int)((connect==4)? y: yr);
+        turn_right(connect);
+    }
+}
+
+template void Edgel::next_padded<LsShape::INF>(Cimage im, int level);
+template void Edgel::next_padded<LsShape::SUP>(Cimage im, int level);
+
+/// Transitions of \c Edgel::next_table, indexed by connectivity (0 for 4, 1
+/// for 8), direction and code of the neighborhood: bit 1 for the pixel ahead
+/// in the level set, bit 0 for the next one on the exterior side. They are
+/// built once from the rules of \c Edgel::next.
+static struct EdgelMoves {
+    EdgelMoves();
+    EdgelMove m[2][8][4];
+} moves;
+
+/// Constructor, filling the table.
+EdgelMoves::EdgelMoves() {
+    for(int c=0; c<2; c++)
+        for(int d=0; d<8; d++)
+            for(int code=0; code<4; code++) {
+                bool L=(code&2)!=0, R=(code&1)!=0;
+                EdgelMove& mv = m[c][d][code];
+                mv.dx = mv.dy = 0;
+                if(d >= DIAGONAL) { // Finish a turn
+                    int b = d-DIAGONAL;
+                    if(c == 0) { // Right turn
+                        mv.dx = DX[b]; mv.dy = DY[b];
+                        mv.dir = (DirEdgel)b;
+                    } else // Left turn
+                        mv.dir = (DirEdgel)((b+1)%DIAGONAL);
+                } else if(L && !R) { // Go straight
+                    mv.dx = DX[d]; mv.dy = DY[d];
+                    mv.dir = (DirEdgel)d;
+                } else if(!L && (!R || c==0)) // Turn left
+                    mv.dir = (DirEdgel)((c==0)? (d+1)%DIAGONAL: d+DIAGONAL);
+                else if(c == 0) { // Begin right turn
+                    mv.dx = DX[d]; mv.dy = DY[d];
+                    mv.dir = (DirEdgel)((d+3)%DIAGONAL + DIAGONAL);
+                } else { // Turn right
+                    mv.dx = (signed char)(DX[d]+EX[d]);
+                    mv.dy = (signed char)(DY[d]+EY[d]);
+                    mv.dir = (DirEdgel)((d+3)%DIAGONAL);
+                }
+            }
+}
+
+/// Move to next edgel along the level line, the level set of type \a type
+/// being in connectivity \a connect.
+void Edgel::next(Cimage im, LsShape::Type type, int level, int connect) {
     if(dir >= DIAGONAL) {
         finish_turn(im, connect);
         return;
@@ -121,3 +233,42 @@ void Edgel::next(Cimage im, LsShape::Type type, int level) {
         turn_right(connect);
     }
 }
+
+/// Same as \c next, by a table of moves. The 2 pixels ahead, the one on the
+/// interior and the one on the exterior side, are coded as 2 bits, which give
+/// the move in a precomputed table. The code is computed without branches
+/// depending on the image: a pixel outside reads the first one, then ignored.
+void Edgel::next_table(Cimage im, LsShape::Type type, int level, int connect) {
+    int code = 0;
+    if(dir < DIAGONAL) {
+        const unsigned w=(unsigned)im->ncol, h=(unsigned)im->nrow;
+        int x=pt.x+DX[dir], y=pt.y+DY[dir];
+        int x2=x+EX[dir], y2=y+EY[dir];
+        bool inA = (unsigned)x<w && (unsigned)y<h;
+        bool inB = inA && (unsigned)x2<w && (unsigned)y2<h;
+        int vA = im->gray[inA? y*(int)w+x: 0];
+        int vB = im->gray[inB? y2*(int)w+x2: 0];
+        bool cA = COMPARE(type, vA, level), cB = COMPARE(type, vB, level);
+        code = ((inA&&cA)? 2: 0) | ((inB&&cB)? 1: 0);
+    }
+    const EdgelMove& mv = moves.m[connect==8][dir][code];
+    pt.x = (short int)(pt.x+mv.dx);
+    pt.y = (short int)(pt.y+mv.dy);
+    dir = mv.dir;
+}
+
+/// Vertical edgels of the closed boundary [\a begin,\a end) in an image of
+/// width \a w, sorted by row, then column. They are put in \a cross as
+/// y*(w+1)+x, with x in [0,w] the column of the edgel. On each row, the
+/// pixels enclosed by the boundary are between consecutive columns taken by
+/// pairs, the first one included and the second one excluded.
+void sort_crossings(const Edgel* begin, const Edgel* end, int w,
+                    std::vector<int>& cross) {
+    cross.clear();
+    for(const Edgel* e=begin; e!=end; ++e)
+        if(e->dir == SOUTH)
+            cross.push_back(e->pt.y*(w+1) + e->pt.x);
+        else if(e->dir == NORTH)
+            cross.push_back(e->pt.y*(w+1) + e->pt.x+1);
+    std::sort(cross.begin(), cross.end());
+}
@@ -13,12 +13,19 @@
 
 #include "shape.h"
 #include <cassert>
+#include <vector>
 
-struct cimage {
+/// Image of gray levels read by the algorithms.
+struct LsImage {
     int nrow, ncol;
     unsigned char* gray;
+    /// Padded image, see \c padded_gray: \c ncol is the stride of rows, the
+    /// width plus 2, and \c gray points to pixel (0,0), inside the frame.
+    bool padded;
+    /// Private areas of TD_PRE explored by runs of pixels in rows
+    bool runs;
 };
-typedef cimage* Cimage;
+typedef LsImage* Cimage;
 inline unsigned char gray(Cimage im, LsPoint pt)
 { return im->gray[pt.y*im->ncol+pt.x]; }
 
@@ -30,6 +37,19 @@ inline int connectivity(LsShape::Type t) {
     return ((t == LsShape::INF)? 4: 8);
 }
 
+/// Strict comparison between numbers, for level sets of type \a t known at
+/// compile time.
+template <LsShape::Type t>
+inline bool compare(int a, int b) { return (t==LsShape::INF)? (a<b): (a>b); }
+
+/// Gray levels of padded image \a im for the tracing of level lines of type
+/// \a t. The image has a frame of one pixel, at 255 for type INF and at 0 for
+/// type SUP, so that it is never in a level set of level in [0,255]. The copy
+/// for type SUP follows the one for type INF, \c im->gray.
+inline const unsigned char* padded_gray(Cimage im, LsShape::Type t) {
+    return (t==LsShape::INF)? im->gray: im->gray + im->ncol*(im->nrow+2);
+}
+
 /// Direction of an edgel.
 typedef unsigned char DirEdgel;
 static const DirEdgel EAST  = 0;
@@ -42,6 +62,13 @@ static const DirEdgel NW = 5;
 static const DirEdgel SW = 6;
 static const DirEdgel SE = 7;
 
+/// Move of the tracer of level lines from an edgel, see Edgel::next_table.
+struct EdgelMove {
+    signed char dx, dy; ///< Move of the interior pixel
+    DirEdgel dir; ///< New direction
+    unsigned char pad; ///< Entries of 4 bytes, for fast indexing
+};
+
 /// Edgel, vertical or horizontal boundary between adjacent pixels.
 class Edgel {
 public:
@@ -56,7 +83,17 @@ public:
     bool inverse(Cimage im);
     LsPoint origin() const;
     bool exterior(LsPoint& ext, Cimage im) const;
-    void next(Cimage im, LsShape::Type type, int level);
+    LsPoint exterior() const;
+    void next(Cimage im, LsShape::Type type, int level) {
+        if(type == LsShape::INF)
+            next<LsShape::INF>(im, level);
+        else
+            next<LsShape::SUP>(im, level);
+    }
+    void next(Cimage im, LsShape::Type type, int level, int connect);
+    void next_table(Cimage im, LsShape::Type type, int level, int connect);
+    template <LsShape::Type t> void next(Cimage im, int level);
+    template <LsShape::Type t> void next_padded(Cimage im, int level);
 
     LsPoint pt; ///< Interior pixel coordinates (left of edgel direction)
     DirEdgel dir; ///< Direction of edgel
@@ -67,6 +104,26 @@ private:
     void finish_turn(Cimage im, int connect);
 };
 
+void sort_crossings(const Edgel* begin, const Edgel* end, int w,
+                    std::vector<int>& cross);
+
+/// Exterior pixel of edgel, in a padded image where it always exists.
+inline LsPoint Edgel::exterior() const {
+    LsPoint ext = pt;
+    switch(dir) {
+    case EAST:  ++ext.y; break;
+    case NORTH: ++ext.x; break;
+    case WEST:  --ext.y; break;
+    case SOUTH: --ext.x; break;
+    case NE: ++ext.y; ++ext.x; break;
+    case NW: ++ext.x; --ext.y; break;
+    case SW: --ext.y; --ext.x; break;
+    case SE: --ext.x; ++ext.y; break;
+    default: assert(false);
+    }
+    return ext;
+}
+
 /// Finish a left or right turn.
 inline void Edgel::finish_turn(Cimage im, int connect) {
     dir -= DIAGONAL;
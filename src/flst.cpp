@@ -8,150 +8,1103 @@
  * All rights reserved.
  */
 
-#include "edgel.h"
-#include "tree.h"
+#include "contour.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
-/// Initialize shape \a s, whose edgel \a e is on the boundary. One pixel of
-/// the private area is found. \a level is the gray level of the parent.
-static void init_shape(Cimage im, LsTree& tree,
-                       LsShape& s, const Edgel& e, int level) {
-    s.type = (gray(im,e.pt) < level)? LsShape::INF: LsShape::SUP;
-    s.gray = (s.type==LsShape::INF)? 0: 255;
-    s.bIgnore = false;
-    s.bBoundary = false;
-    s.area = 1;
+/// Minimum area of subtrees extracted by a task in parallel mode.
+static const int MIN_TASK_AREA = 4096;
 
+/// Criteria of shapes kept in the tree, besides the root.
+struct LsKeep {
+    int minArea, maxArea; ///< Range of area
+    /// Maximum difference of gray level with the nearest kept ancestor of
+    /// shapes that are not kept, 0 for none
+    int tolerance;
+};
+
+/// Shape of pixel \a i in \a index. In parallel mode, the tasks and the main
+/// thread explore the pixels around the subtrees they extract, which other
+/// threads may be writing at the same time. The accesses to the index are
+/// thus relaxed atomic, which are plain loads and stores on usual
+/// processors. The order of these accesses does not matter: a pixel outside
+/// the subtree of a thread is never free for it (see \c is_free), whatever
+/// the value it reads there.
+inline LsShape* shape_at(LsShape* const* index, int i) {
+    LsShape* s;
+#ifdef _OPENMP
+#pragma omp atomic read
+#endif
+    s = index[i];
+    return s;
+}
+
+/// Set the shape of pixel \a i in \a index to \a s, see \c shape_at.
+inline void set_shape(LsShape** index, int i, LsShape* s) {
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+    index[i] = s;
+}
+
+/// Is pixel with smallest shape \a p still to assign by the extraction using
+/// workspace \a ws? It is if null, or if it is on the boundary of the shape
+/// being initialized, marked by \c LsWorkspace::mark. A workspace initializes
+/// one shape at a time and the exploration of its private area assigns all
+/// the marked pixels, before the next shape. The parallel tasks having their
+/// own workspace, the pixels marked by other tasks are taken, as they would
+/// be in sequential order.
+inline bool is_free(const LsShape* p, const LsWorkspace& ws) {
+    return (p == 0 || p == &ws.mark);
+}
+
+/// Move edgel \a e along the level line of type \a t at \a level, without
+/// bounds checks if image \a im is padded.
+template <LsShape::Type t>
+inline void step(Cimage im, Edgel& e, int level) {
+    if(im->padded)
+        e.next_padded<t>(im, level);
+    else
+        e.next<t>(im, level);
+}
+
+/// Follow the boundary of a shape of type \a t from its edgel \a e, see
+/// \c trace_boundary.
+template <int C, LsShape::Type t, class T>
+static void walk_boundary(Cimage im, T& tree, const Edgel& e, int level,
+                          const Edgel* line, unsigned char& g, LsPoint& p,
+                          LsWorkspace& ws) {
+    g = (t==LsShape::INF)? 0: 255;
+
+    begin_contour<C>(tree);
     Edgel cur = e;
     do {
-#ifdef BOUNDARY
-        if(cur.dir < DIAGONAL)
-            s.contour.push_back(cur.origin());
-#endif
+        add_contour<C>(tree, cur);
         int j = cur.pt.y * im->ncol + cur.pt.x;
         unsigned char v = im->gray[j];
-        if(! COMPARE(s.type, v, s.gray)) {
-            s.gray = v;
-            s.pixels[0] = cur.pt;
+        if(! compare<t>(v, g)) {
+            g = v;
+            p = cur.pt;
         }
-        assert(!tree.smallestShape[j] || tree.smallestShape[j] == s.parent);
-        tree.smallestShape[j] = 0;
-        cur.next(im, s.type, level);
+        set_shape(tree.smallestShape, j, &ws.mark);
+        if(line)
+            cur = *++line;
+        else
+            step<t>(im, cur, level);
     } while(cur != e);
+}
+
+/// Follow the boundary of a shape from its edgel \a e, \a level being the gray
+/// level of its parent, and mark its pixels with \c LsWorkspace::mark of
+/// \a ws. Return the type of the shape, put its gray level in \a g and one of
+/// its pixels at that level in \a p. The level line is stored according to
+/// \a C. If \a line is not null, it is the boundary recorded by
+/// \c find_child, read instead of walking again.
+template <int C, class T>
+static LsShape::Type trace_boundary(Cimage im, T& tree, const Edgel& e,
+                                    int level, const Edgel* line,
+                                    unsigned char& g, LsPoint& p,
+                                    LsWorkspace& ws) {
+    LsShape::Type type = (gray(im,e.pt) < level)? LsShape::INF: LsShape::SUP;
+    if(type == LsShape::INF)
+        walk_boundary<C,LsShape::INF>(im, tree, e, level, line, g, p, ws);
+    else
+        walk_boundary<C,LsShape::SUP>(im, tree, e, level, line, g, p, ws);
+    return type;
+}
+
+/// Recorded boundary of the child of seed index \a i in \a ws, null if
+/// \a i is negative.
+inline const Edgel* seed_line(const LsWorkspace& ws, int i) {
+    return (i<0)? 0: &ws.seedLines[ws.seedLine[i]];
+}
+
+/// Initialize shape \a s, whose edgel \a e is on the boundary. One pixel of
+/// the private area is found. \a level is the gray level of the parent.
+/// The level line is stored according to \a C, see begin_contour. The
+/// boundary is \a line if not null, see \c trace_boundary.
+template <int C, class T>
+static void init_shape(Cimage im, T& tree, LsShape& s, const Edgel& e,
+                       int level, const Edgel* line, LsWorkspace& ws) {
+    s.type = trace_boundary<C>(im, tree, e, level, line, s.gray, s.pixels[0],
+                               ws);
+    s.bIgnore = false;
+    s.bBoundary = false;
+    s.area = 1;
+
+    set_shape(tree.smallestShape, s.pixels[0].y*im->ncol+s.pixels[0].x, &s);
+}
 
-    int i = s.pixels[0].y*im->ncol+s.pixels[0].x;
-    tree.smallestShape[i] = &s;
+/// Gray level of the parent of the shape of seed edgel \a e, the one of its
+/// exterior pixel, in the private area of the parent.
+inline int seed_level(Cimage im, const Edgel& e) {
+    LsPoint p;
+    e.exterior(p, im);
+    return gray(im, p);
 }
 
 /// Follow boundary of a child of shape \a s, starting at edgel \a e. Pixels
 /// on the immediate exterior at the gray level of \a s are added to the
 /// private area. The pixels on the immediate interior are marked as if they
 /// were in the private area of \a s, to avoid following again the boundary.
-static void find_child(Cimage im, LsTree& tree, LsShape& s, const Edgel& e) {
-    LsShape::Type type = (gray(im,e.pt) < s.gray)? LsShape::INF: LsShape::SUP;
+/// The boundary is appended to \c ws.seedLines, closed by \a e again, so that
+/// the extraction of the child does not walk it again. Return the area of the
+/// child, enclosed by the boundary, and put its gray level in \a g.
+/// The child is of type \a t.
+template <LsShape::Type t, class T>
+static int walk_child(Cimage im, T& tree, LsShape& s, const Edgel& e,
+                      unsigned char& g, LsWorkspace& ws) {
+    std::vector<Edgel>& line = ws.seedLines;
+    g = (t==LsShape::INF)? 0: 255;
 
+    int area = 0; // Integral of x dy along the boundary
     Edgel cur = e;
     do {
+        line.push_back(cur);
         int i = cur.pt.y * im->ncol + cur.pt.x;
-        assert(COMPARE(type, im->gray[i], s.gray));
-        assert(tree.smallestShape[i] == 0 || tree.smallestShape[i] == &s);
-        tree.smallestShape[i] = &s;
+        assert(compare<t>(im->gray[i], s.gray));
+        assert(is_free(shape_at(tree.smallestShape,i), ws) ||
+               shape_at(tree.smallestShape,i) == &s);
+        set_shape(tree.smallestShape, i, &s);
+        if(! compare<t>(im->gray[i], g))
+            g = im->gray[i];
+        if(cur.dir == NORTH)
+            area -= cur.pt.x+1;
+        else if(cur.dir == SOUTH)
+            area += cur.pt.x;
         LsPoint pt;
-        if(cur.exterior(pt, im)) {
+        if(im->padded)
+            pt = cur.exterior(); // In the frame if outside, never free
+        if(im->padded || cur.exterior(pt, im)) {
             i = pt.y * im->ncol + pt.x;
-            if(tree.smallestShape[i] == 0 && im->gray[i] == s.gray) {
+            if(is_free(shape_at(tree.smallestShape,i), ws) &&
+               im->gray[i] == s.gray) {
                 s.pixels[s.area++] = pt;
-                tree.smallestShape[i] = &s;
+                set_shape(tree.smallestShape, i, &s);
             }
         }
-        cur.next(im, type, s.gray);
+        step<t>(im, cur, s.gray);
     } while(cur != e);
+    line.push_back(e);
+    return (area<0)? -area: area;
 }
 
+/// Follow boundary of a child of shape \a s, see \c walk_child.
+template <class T>
+static int find_child(Cimage im, T& tree, LsShape& s, const Edgel& e,
+                      unsigned char& g, LsWorkspace& ws) {
+    if(gray(im,e.pt) < s.gray)
+        return walk_child<LsShape::INF>(im, tree, s, e, g, ws);
+    return walk_child<LsShape::SUP>(im, tree, s, e, g, ws);
+}
+
+/// Is the diagonal edge between pixels of levels \a vi and \a ve in the level
+/// set of \a vi? Only upper level sets, of type SUP, are 8-connected.
 inline bool edge8(unsigned char vi, unsigned char ve) {
-    if(vi == ve)
-        return false;
-    return (connectivity((vi<ve)? LsShape::INF: LsShape::SUP)==8);
+    return (vi > ve);
 }
 
-/// Consider the exterior pixel of edgel \a e. If it is at the level of
-/// shape \a s, add it to the private area. Otherwise, follow the boundary of
-/// the child shape, adding to the private area the pixels on its immediate
-/// exterior at level of \a s.
+/// Consider pixel of index \a i, interior to edgel \a e, the inverse of an
+/// edgel of shape \a s. If it is at the level of \a s, add it to the private
+/// area. Otherwise, follow the boundary of the child shape, adding to the
+/// private area the pixels on its immediate exterior at level of \a s. The
+/// seed edgel of the child, its area, its gray level and its boundary are
+/// put in \a ws. Return whether the edge belongs to the shape.
+template <class T>
+static bool visit(Cimage im, T& tree, LsShape& s, const Edgel& e, int i,
+                  LsWorkspace& ws) {
+    if(is_free(shape_at(tree.smallestShape,i), ws)) {
+        if(im->gray[i] == s.gray) {
+            s.pixels[s.area++] = e.pt;
+            set_shape(tree.smallestShape, i, &s);
+        } else {
+            unsigned char g;
+            ws.seeds.push_back(e);
+            ws.seedLine.push_back(ws.seedLines.size());
+            ws.seedArea.push_back(find_child(im, tree, s, e, g, ws));
+            ws.seedGray.push_back(g);
+        }
+    }
+    return edge8(s.gray, im->gray[i]);
+}
+
+/// Consider the exterior pixel of edgel \a e, see \c visit.
 /// Return whether the edge belongs to the shape and is on its boundary.
-static bool add_neighbor(Cimage im, LsTree& tree, LsShape& s, Edgel e,
-                         std::vector<Edgel>& children) {
+template <class T>
+static bool add_neighbor(Cimage im, T& tree, LsShape& s, Edgel e,
+                         LsWorkspace& ws) {
     if(! e.inverse(im)) {
         s.bBoundary = true;
         return false;
     }
-    int i = e.pt.y*im->ncol + e.pt.x;
-    if(! tree.smallestShape[i]) {
-        if(im->gray[i] == s.gray) {
-            s.pixels[s.area++] = e.pt;
-            tree.smallestShape[i] = &s;
+    return visit(im, tree, s, e, e.pt.y*im->ncol + e.pt.x, ws);
+}
+
+/// Visit the exterior pixel of the edgel of direction \a d of pixel \a pt,
+/// of index \a j, of shape \a s, see \c visit. There is no bounds check: the
+/// pixel is in the image, or in the frame of a padded image \a im, whose
+/// pixels are never free. Edgel \a e is scratch.
+template <class T>
+inline bool visit_at(Cimage im, T& tree, LsShape& s, LsPoint pt, int j,
+                     DirEdgel d, Edgel& e, LsWorkspace& ws) {
+    static const signed char dx[8] = {0, 1, 0,-1, 1, 1,-1,-1};
+    static const signed char dy[8] = {1, 0,-1, 0, 1,-1,-1, 1};
+    static const DirEdgel inverse[8] = {WEST,SOUTH,EAST,NORTH, SW,SE,NE,NW};
+    e.pt.x = (short int)(pt.x+dx[d]);
+    e.pt.y = (short int)(pt.y+dy[d]);
+    e.dir = inverse[d];
+    return visit(im, tree, s, e, j + dy[d]*im->ncol + dx[d], ws);
+}
+
+/// Visit the pixels of row \a y in [\a x0,\a x1], neighbors of a run of
+/// private pixels of shape \a s by edgels of direction \a d (WEST for the row
+/// above, EAST for the one below). A free pixel at the level of \a s is added
+/// to the private area with all free pixels at this level to its left and
+/// right, so that the private area is a sequence of runs. Put in \a e0 and
+/// \a e1 whether the edges at \a x0 and \a x1 are on the boundary of \a s.
+template <class T>
+static void visit_row(Cimage im, T& tree, LsShape& s, int y, int x0, int x1,
+                      DirEdgel d, bool& e0, bool& e1, LsWorkspace& ws) {
+    const int w = im->padded? im->ncol-2: im->ncol;
+    e0 = e1 = false;
+    if(! im->padded && (y < 0 || y >= im->nrow)) {
+        s.bBoundary = true;
+        return;
+    }
+    LsShape** index = tree.smallestShape + y*im->ncol;
+    const unsigned char* g = im->gray + y*im->ncol;
+    for(int x=x0; x<=x1; x++) {
+        if(! is_free(shape_at(index,x), ws))
+            continue;
+        if(g[x] == s.gray) { // New run of private pixels
+            int xl=x, xr=x;
+            while(xl>0 && is_free(shape_at(index,xl-1),ws) && g[xl-1]==s.gray)
+                --xl;
+            while(xr+1<w && is_free(shape_at(index,xr+1),ws) && g[xr+1]==s.gray)
+                ++xr;
+            for(LsPoint p={(short int)xl,(short int)y}; p.x<=xr; p.x++) {
+                s.pixels[s.area++] = p;
+                set_shape(index, p.x, &s);
+            }
+            x = xr;
         } else {
-            children.push_back(e);
-            find_child(im, tree, s, e);
+            Edgel e(x, y, (d==WEST)? EAST: WEST); // Inverse edgel
+            visit(im, tree, s, e, y*im->ncol+x, ws);
         }
     }
-    return edge8(s.gray, im->gray[i]);
+    e0 = edge8(s.gray, g[x0]);
+    e1 = edge8(s.gray, g[x1]);
 }
 
-/// Fill the private area of shape \a s and find its children.
-/// Put in \a children one seed edgel per child.
-static void find_pp_children(Cimage im, LsTree& tree, LsShape& s,
-                             std::vector<Edgel>& children) {
-    for(int i = 0; i < s.area; i++) {
+/// Visit the exterior pixel of the edgel of direction \a d of pixel \a pt
+/// of shape \a s, see \c visit, with a bounds check if \a im is not padded.
+template <class T>
+inline bool visit_dir(Cimage im, T& tree, LsShape& s, LsPoint pt, DirEdgel d,
+                      LsWorkspace& ws) {
+    Edgel e(pt, d);
+    if(! im->padded)
+        return add_neighbor(im, tree, s, e, ws);
+    return visit_at(im, tree, s, pt, pt.y*im->ncol+pt.x, d, e, ws);
+}
+
+/// Same as \c find_pp_children, but exploring by runs of private pixels in a
+/// row, which are inside a flat zone. The pixels of the run have no boundary
+/// edge between them, so that only the ends of the run have neighbors to the
+/// left and right, and possibly diagonal ones, while the rows above and below
+/// are scanned once, adding their flat zones by runs, see \c visit_row.
+template <class T>
+static void find_pp_runs(Cimage im, T& tree, LsShape& s, int begin,
+                         LsWorkspace& ws) {
+    for(int i = begin; i < s.area; ) {
+        const LsPoint p0 = s.pixels[i];
+        LsPoint p1 = p0;
+        while(++i<s.area && s.pixels[i].y==p0.y && s.pixels[i].x==p1.x+1)
+            p1.x++;
+        bool L = visit_dir(im, tree, s, p0, SOUTH, ws); // Left
+        bool R = visit_dir(im, tree, s, p1, NORTH, ws); // Right
+        bool A0, A1, B0, B1; // Above and below, at both ends
+        visit_row(im, tree, s, p0.y-1, p0.x, p1.x, WEST, A0, A1, ws);
+        visit_row(im, tree, s, p0.y+1, p0.x, p1.x, EAST, B0, B1, ws);
+        if(R && B1) visit_dir(im, tree, s, p1, NE, ws);
+        if(R && A1) visit_dir(im, tree, s, p1, NW, ws);
+        if(L && A0) visit_dir(im, tree, s, p0, SW, ws);
+        if(L && B0) visit_dir(im, tree, s, p0, SE, ws);
+    }
+}
+
+/// Fill the private area of shape \a s and find its children, exploring from
+/// its private pixel of index \a begin. Put in \a ws one seed edgel per child.
+/// The exploration is by runs of pixels if \c im->runs, see \c find_pp_runs.
+template <class T>
+static void find_pp_children(Cimage im, T& tree, LsShape& s, int begin,
+                             LsWorkspace& ws) {
+    if(im->runs) {
+        find_pp_runs(im, tree, s, begin, ws);
+        return;
+    }
+    if(im->padded) { // Field bBoundary is not set
+        for(int i = begin; i < s.area; i++) {
+            const LsPoint pt = s.pixels[i];
+            int j = pt.y*im->ncol + pt.x;
+            assert(shape_at(tree.smallestShape,j) == &s);
+            Edgel e(pt);
+            bool E = visit_at(im, tree, s, pt, j, EAST,  e, ws);
+            bool N = visit_at(im, tree, s, pt, j, NORTH, e, ws);
+            bool W = visit_at(im, tree, s, pt, j, WEST,  e, ws);
+            bool S = visit_at(im, tree, s, pt, j, SOUTH, e, ws);
+            if(N && E) visit_at(im, tree, s, pt, j, NE, e, ws);
+            if(N && W) visit_at(im, tree, s, pt, j, NW, e, ws);
+            if(S && W) visit_at(im, tree, s, pt, j, SW, e, ws);
+            if(S && E) visit_at(im, tree, s, pt, j, SE, e, ws);
+        }
+        return;
+    }
+    for(int i = begin; i < s.area; i++) {
         const LsPoint& pt = s.pixels[i];
-        assert(tree.smallestShape[pt.y*im->ncol+pt.x] == &s);
+        assert(shape_at(tree.smallestShape,pt.y*im->ncol+pt.x) == &s);
         Edgel e(pt.x, pt.y, EAST);
 
-        e.dir = EAST;   bool E = add_neighbor(im, tree, s, e, children);
-        e.dir = NORTH;  bool N = add_neighbor(im, tree, s, e, children);
-        e.dir = WEST;   bool W = add_neighbor(im, tree, s, e, children);
-        e.dir = SOUTH;  bool S = add_neighbor(im, tree, s, e, children);
+        e.dir = EAST;   bool E = add_neighbor(im, tree, s, e, ws);
+        e.dir = NORTH;  bool N = add_neighbor(im, tree, s, e, ws);
+        e.dir = WEST;   bool W = add_neighbor(im, tree, s, e, ws);
+        e.dir = SOUTH;  bool S = add_neighbor(im, tree, s, e, ws);
 
-        e.dir = NE;   if(N && E) add_neighbor(im, tree, s, e, children);
-        e.dir = NW;   if(N && W) add_neighbor(im, tree, s, e, children);
-        e.dir = SW;   if(S && W) add_neighbor(im, tree, s, e, children);
-        e.dir = SE;   if(S && E) add_neighbor(im, tree, s, e, children);
+        e.dir = NE;   if(N && E) add_neighbor(im, tree, s, e, ws);
+        e.dir = NW;   if(N && W) add_neighbor(im, tree, s, e, ws);
+        e.dir = SW;   if(S && W) add_neighbor(im, tree, s, e, ws);
+        e.dir = SE;   if(S && E) add_neighbor(im, tree, s, e, ws);
     }
 }
 
+/// Append to \a bound the level line of type \a t from edgel \a e, separating
+/// it from pixels beyond \a level.
+template <LsShape::Type t>
+static void walk_line(Cimage im, const Edgel& e, int level,
+                      std::vector<Edgel>& bound) {
+    Edgel cur = e;
+    do {
+        bound.push_back(cur);
+        step<t>(im, cur, level);
+    } while(cur != e);
+}
+
+/// Add to the private area of shape \a s all pixels of its child of seed
+/// edgel \a e, which is not kept in the tree with its subtree. They are the
+/// pixels enclosed by the boundary of the child, \a line if not null (see
+/// \c trace_boundary), stored in \a pixels. Return their number.
+template <class T>
+static int merge_child(Cimage im, T& tree, LsShape& s, const Edgel& e,
+                       const Edgel* line, LsPoint* pixels, LsWorkspace& ws) {
+    const Edgel* end = line;
+    if(line)
+        while(*++end != e) {}
+    else {
+        int level = seed_level(im, e);
+        ws.bound.clear();
+        if(gray(im,e.pt) < level)
+            walk_line<LsShape::INF>(im, e, level, ws.bound);
+        else
+            walk_line<LsShape::SUP>(im, e, level, ws.bound);
+        line = &ws.bound[0];
+        end = line + ws.bound.size();
+    }
+    sort_crossings(line, end, im->ncol, ws.cross);
+    int n = 0;
+    for(size_t i=0; i<ws.cross.size(); i+=2) {
+        int y = ws.cross[i]/(im->ncol+1);
+        int x0=ws.cross[i]%(im->ncol+1), x1=ws.cross[i+1]%(im->ncol+1);
+        for(LsPoint p={(short int)x0,(short int)y}; p.x<x1; p.x++) {
+            pixels[n++] = p;
+            set_shape(tree.smallestShape, y*im->ncol+p.x, &s);
+        }
+        if(x0==0 || x1==im->ncol || y==0 || y+1==im->nrow)
+            s.bBoundary = true;
+    }
+    return n;
+}
+
+/// Add to the private area of shape \a s the private pixels of its child of
+/// seed edgel \a e and boundary \a line, which is not kept in the tree, and
+/// put in \a ws the seeds of the children of the child, which become children
+/// of \a s.
+template <class T>
+static void remove_child(Cimage im, T& tree, LsShape& s, const Edgel& e,
+                         const Edgel* line, LsWorkspace& ws) {
+    unsigned char g = s.gray;
+    int begin = s.area;
+    LsPoint& p = s.pixels[s.area++];
+    trace_boundary<LsTree::NO_CONTOUR>(im, tree, e, seed_level(im, e), line,
+                                       s.gray, p, ws);
+    set_shape(tree.smallestShape, p.y*im->ncol+p.x, &s);
+    find_pp_children(im, tree, s, begin, ws); // At gray level of the child
+    s.gray = g;
+}
+
+/// Remove the children of shape \a s not satisfying \a keep, whose seeds in
+/// \a ws are from index \a begin. The subtree of a child below the minimum
+/// area goes to the private area of \a s. A child above the maximum area or
+/// within the tolerance of the gray level of \a s is replaced by its
+/// children, its private pixels going to \a s.
+template <class T>
+static void prune_children(Cimage im, T& tree, LsShape& s, size_t begin,
+                           const LsKeep& keep, LsWorkspace& ws) {
+    size_t n = begin;
+    for(size_t i=begin; i<ws.seeds.size(); i++) {
+        Edgel e = ws.seeds[i];
+        int area = ws.seedArea[i];
+        unsigned char g = ws.seedGray[i];
+        size_t line = ws.seedLine[i];
+        if(area < keep.minArea)
+            s.area += merge_child(im, tree, s, e, &ws.seedLines[line],
+                                  s.pixels+s.area, ws);
+        else if(area > keep.maxArea ||
+                (keep.tolerance>0 && abs(g-s.gray)<=keep.tolerance))
+            remove_child(im, tree, s, e, &ws.seedLines[line], ws); // Appends
+        else {
+            ws.seeds[n] = e;
+            ws.seedArea[n] = area;
+            ws.seedGray[n] = g;
+            ws.seedLine[n++] = line;
+        }
+    }
+    ws.seeds.erase(ws.seeds.begin()+n, ws.seeds.end());
+    ws.seedArea.erase(ws.seedArea.begin()+n, ws.seedArea.end());
+    ws.seedGray.erase(ws.seedGray.begin()+n, ws.seedGray.end());
+    ws.seedLine.erase(ws.seedLine.begin()+n, ws.seedLine.end());
+}
+
+/// Find the private pixels and children seeds of new shape \a s, whose edgel
+/// \a e is on the boundary, and push it on the stack \c ws.preFrames.
+/// Children not satisfying \a keep are not kept. The boundary is \a line if
+/// not null, see \c trace_boundary.
+template <int C, class T>
+static void push_shape(Cimage im, T& tree, LsShape& s, const Edgel& e,
+                       int level, const Edgel* line, const LsKeep& keep,
+                       LsWorkspace& ws) {
+    if(level<0 && im->padded) // Root, whose level set would include the frame
+        line = &ws.bound[0]; // Recorded by pad
+    init_shape<C>(im, tree, s, e, level, line, ws);
+    LsWorkspace::PreFrame f;
+    f.s = &s;
+    f.line = ws.seedLines.size();
+    f.begin = f.next = ws.seeds.size();
+    find_pp_children(im, tree, s, 0, ws);
+    prune_children(im, tree, s, f.begin, keep, ws);
+    f.end = ws.seeds.size();
+    ws.preFrames.push_back(f);
+}
+
+/// Remove from \a ws the shape at the top of the stack, whose children are
+/// all built.
+static void pop_shape(LsWorkspace& ws) {
+    LsWorkspace::PreFrame& f = ws.preFrames.back();
+    ws.seeds.erase(ws.seeds.begin()+f.begin, ws.seeds.end());
+    ws.seedArea.erase(ws.seedArea.begin()+f.begin, ws.seedArea.end());
+    ws.seedGray.erase(ws.seedGray.begin()+f.begin, ws.seedGray.end());
+    ws.seedLine.erase(ws.seedLine.begin()+f.begin, ws.seedLine.end());
+    ws.seedLines.erase(ws.seedLines.begin()+f.line, ws.seedLines.end());
+    LsShape& s = *f.s;
+    ws.preFrames.pop_back();
+    if(! ws.preFrames.empty())
+        ws.preFrames.back().s->area += s.area;
+}
+
 /// Extract tree of shapes rooted at \a root.
+/// The depth of the tree may be large (one level per gray level in a ramp,
+/// one per ring in concentric patterns), so the descent uses an explicit
+/// stack instead of recursion.
 /// \param im the input image.
 /// \param tree the output tree, where newly extracted shapes are appended.
 /// \param root the current root of the tree.
 /// \param e an edgel at the boundary of \a root.
 /// \param level gray level of parent.
-static void create_tree(Cimage im, LsTree& tree, LsShape& root,
-                        const Edgel& e, int level) {
-    init_shape(im, tree, root, e, level);
+/// \param keep criteria of shapes kept in the tree.
+/// \param ws the stacks of shapes under construction and seeds.
+template <int C, class T>
+static void create_tree(Cimage im, T& tree, LsShape& root,
+                        const Edgel& e, int level, const LsKeep& keep,
+                        LsWorkspace& ws) {
+    std::vector<LsWorkspace::PreFrame>& frames = ws.preFrames;
+    push_shape<C>(im, tree, root, e, level, 0, keep, ws);
+    while(! frames.empty()) {
+        LsWorkspace::PreFrame& f = frames.back();
+        if(f.next == f.end) { // All children built
+            pop_shape(ws);
+            continue;
+        }
+        LsShape& s = *f.s;
+        int i = (int)f.next++;
+        Edgel seed = ws.seeds[i];
+        LsShape* child = tree.add_child(s);
+        child->pixels = s.pixels + s.area;
+        push_shape<C>(im, tree, *child, seed, seed_level(im,seed),
+                      seed_line(ws,i), keep, ws);
+    }
+}
+
+/// Subtrees of consecutive children of a shape, extracted by a task in
+/// parallel mode. It has the interface of LsTree used by the extraction.
+/// Since the areas of the children are known from their boundary, the
+/// ranges of their pixels are known before extraction.
+struct LsSubtree {
+    LsSubtree(LsShape* p, LsShape** index, const LsKeep& keep)
+    : parent(p), area(0), keep(keep),
+      smallestShape(index), iFree(0) {}
+    LsShape* add_child(LsShape& p);
+    LsShape* add_root();
+
+    LsShape* parent; ///< Parent of roots of subtrees
+    LsPoint* pixels; ///< Pixels of first root
+    std::vector<Edgel> seeds; ///< Edgel on boundary of each root
+    std::vector<int> areas; ///< Area of each root
+    int area; ///< Sum of areas
+    LsKeep keep; ///< Criteria of shapes kept in the tree
 
-    std::vector<Edgel> children;
-    find_pp_children(im, tree, root, children);
+    LsShape** smallestShape; ///< Index of the tree, shared by all tasks
+    std::vector<LsShape*> shapes; ///< Extracted shapes, in order
+    std::vector<LsShape*> blocks; ///< Storage of shapes
+    int iFree; ///< Number of free shapes in last block
+    std::vector<LsPoint> contours; ///< As LsTree::contours
+    std::vector<size_t> contourStart; ///< As LsTree::contourStart
+    LsChainCodes chains; ///< As LsTree::chains
+private:
+    LsShape* new_shape();
+};
+
+/// Allocate a new shape. Blocks double in size, the area being an upper
+/// bound of the number of shapes.
+LsShape* LsSubtree::new_shape() {
+    int n = (int)shapes.size();
+    if(iFree == 0) {
+        iFree = std::min(std::max(n,64), area-n);
+        assert(iFree > 0);
+        blocks.push_back(new LsShape[iFree]);
+    }
+    LsShape* s = blocks.back() + (--iFree);
+    shapes.push_back(s);
+    return s;
+}
 
-    std::vector<Edgel>::const_iterator it = children.begin();
-    for(; it != children.end(); ++it) {
-        LsShape* child = tree.add_child(root);
-        child->pixels = root.pixels + root.area;
-        create_tree(im, tree, *child, *it, root.gray);
-        root.area += child->area;
+/// Add a new child to shape \a p.
+LsShape* LsSubtree::add_child(LsShape& p) {
+    LsShape* s = new_shape();
+    s->parent = &p;
+    s->sibling = p.child;
+    s->child = 0;
+    p.child = s;
+    return s;
+}
+
+/// Add a new root, child of \c parent. It is not linked to its siblings,
+/// which are done at compaction of the whole tree.
+LsShape* LsSubtree::add_root() {
+    LsShape* s = new_shape();
+    s->parent = parent;
+    s->sibling = s->child = 0;
+    return s;
+}
+
+/// Extract the subtrees of a task.
+template <int C>
+static void extract_subtrees(Cimage im, LsSubtree& sub) {
+    LsWorkspace ws;
+    LsPoint* pixels = sub.pixels;
+    for(size_t i=0; i<sub.seeds.size(); i++) {
+        LsShape* s = sub.add_root();
+        s->pixels = pixels;
+        create_tree<C>(im, sub, *s, sub.seeds[i], seed_level(im,sub.seeds[i]),
+                       sub.keep, ws);
+        assert(s->area == sub.areas[i]);
+        pixels += sub.areas[i];
+    }
+}
+
+/// Sequence of shapes in the tree order: either shapes of indices
+/// [begin,end) in order of creation by the main thread, or all shapes of
+/// \c task.
+struct LsSegment {
+    LsSubtree* task;
+    size_t begin, end;
+};
+
+/// Start the extraction of \a task in parallel, and record the segments of
+/// shapes of the main thread before it, from index \a begin, and of the task.
+template <int C>
+static void launch(Cimage im, LsSubtree*& task,
+                   const std::vector<LsShape*>& main, size_t& begin,
+                   std::vector<LsSegment>& segments) {
+    if(! task)
+        return;
+    if(begin < main.size()) {
+        LsSegment seg = {0, begin, main.size()};
+        segments.push_back(seg);
+        begin = main.size();
+    }
+    LsSegment seg = {task, 0, 0};
+    segments.push_back(seg);
+    LsSubtree* t = task;
+#pragma omp task firstprivate(t)
+    extract_subtrees<C>(im, *t);
+    task = 0;
+}
+
+/// Extract tree of shapes rooted at \a root, giving subtrees of area at most
+/// \a grain to parallel tasks. Consecutive such children of a shape are
+/// grouped in the same task until their total area reaches \a grain.
+/// The shapes created by the calling thread are put in \a main, in order, and
+/// the sequence of shapes of the tree in \a segments. Only shapes satisfying
+/// \a keep are kept.
+template <int C>
+static void create_tree_tasks(Cimage im, LsTree& tree, LsShape& root,
+                              const Edgel& e, const LsKeep& keep,
+                              LsWorkspace& ws, int grain,
+                              std::vector<LsShape*>& main,
+                              std::vector<LsSegment>& segments) {
+    std::vector<LsWorkspace::PreFrame>& frames = ws.preFrames;
+    LsSubtree* task = 0; // Task being filled
+    size_t begin = 0; // Start of segment of main
+    main.push_back(&root);
+    push_shape<C>(im, tree, root, e, -1, 0, keep, ws);
+    while(! frames.empty()) {
+        LsWorkspace::PreFrame& f = frames.back();
+        if(f.next == f.end) { // All children built or given to tasks
+            launch<C>(im, task, main, begin, segments);
+            pop_shape(ws);
+            continue;
+        }
+        LsShape& s = *f.s;
+        int i = (int)f.next++;
+        Edgel seed = ws.seeds[i];
+        int area = ws.seedArea[i];
+        if(area <= grain) { // Extracted by a task, walking the boundary
+            if(! task) {
+                task = new LsSubtree(&s, tree.smallestShape, keep);
+                task->pixels = s.pixels + s.area;
+            }
+            task->seeds.push_back(seed);
+            task->areas.push_back(area);
+            task->area += area;
+            s.area += area;
+            if(task->area >= grain)
+                launch<C>(im, task, main, begin, segments);
+            continue;
+        }
+        launch<C>(im, task, main, begin, segments);
+        LsShape* child = tree.add_child(s);
+        main.push_back(child);
+        child->pixels = s.pixels + s.area;
+        push_shape<C>(im, tree, *child, seed, seed_level(im,seed),
+                      seed_line(ws,i), keep, ws);
+    }
+    if(begin < main.size()) {
+        LsSegment seg = {0, begin, main.size()};
+        segments.push_back(seg);
     }
 }
 
+/// Extract the tree with \a nThreads threads, or the sequential algorithm if
+/// there is only one. Only shapes satisfying \a keep are kept, besides the
+/// root.
+template <int C>
+void LsTree::flst_td_pre(Cimage im, LsWorkspace& ws, int nThreads,
+                         const LsKeep& keep) {
+    Edgel e(0, 0, SOUTH);
+    if(nThreads == 1) {
+        create_tree<C>(im, *this, shapes[0], e, -1, keep, ws);
+        return;
+    }
+    int grain = std::max(ncol*nrow/(8*nThreads), MIN_TASK_AREA);
+    std::vector<LsShape*> main;
+    std::vector<LsSegment> segments;
+#pragma omp parallel num_threads(nThreads)
+#pragma omp single
+    create_tree_tasks<C>(im, *this, shapes[0], e, keep, ws, grain,
+                         main, segments);
+
+    // Gather shapes and level lines in tree order
+    std::vector<LsPoint> points;
+    std::vector<size_t> starts;
+    LsChainCodes codes;
+    for(size_t i=0; i<segments.size(); i++) {
+        const LsSegment& seg = segments[i];
+        if(seg.task) {
+            LsSubtree& t = *seg.task;
+            order.insert(order.end(), t.shapes.begin(), t.shapes.end());
+            for(size_t j=0; j<t.contourStart.size(); j++)
+                starts.push_back(points.size() + t.contourStart[j]);
+            points.insert(points.end(), t.contours.begin(), t.contours.end());
+            if(C & CONTOUR_CHAIN)
+                codes.append(t.chains, 0, t.chains.start.size());
+            taskBlocks.insert(taskBlocks.end(),t.blocks.begin(),t.blocks.end());
+            delete seg.task;
+            continue;
+        }
+        order.insert(order.end(), main.begin()+seg.begin, main.begin()+seg.end);
+        if(C & CONTOUR_POINTS) {
+            size_t b = contourStart[seg.begin];
+            size_t e = (seg.end<contourStart.size())? contourStart[seg.end]:
+                contours.size();
+            for(size_t j=seg.begin; j<seg.end; j++)
+                starts.push_back(points.size() + contourStart[j]-b);
+            points.insert(points.end(), contours.begin()+b, contours.begin()+e);
+        }
+        if(C & CONTOUR_CHAIN)
+            codes.append(chains, seg.begin, seg.end);
+    }
+    iNbShapes = (int)order.size();
+    contours.swap(points);
+    contourStart.swap(starts);
+    std::swap(chains, codes);
+}
+
+/// Copy image \a im in \c ws.padded with a frame of one pixel, see
+/// \c padded_gray, and put in \a padded the view of the padded image. The
+/// index \c ws.index of the shapes of pixels gets the same frame, its pixels
+/// taken by shape \a frame. The boundary of the root, which cannot be traced
+/// in the padded image, is put in \c ws.bound, closed by its first edgel.
+static void pad(Cimage im, LsShape* frame, LsWorkspace& ws,
+                LsImage& padded) {
+    int w=im->ncol, h=im->nrow, stride=w+2, n=stride*(h+2);
+    ws.padded.assign(n, 255); // Copy for INF
+    ws.padded.resize(2*n, 0); // Copy for SUP
+    ws.index.assign(n, frame);
+    for(int y=0; y<h; y++) {
+        const unsigned char* row = im->gray + y*w;
+        int i = (y+1)*stride + 1;
+        std::copy(row, row+w, ws.padded.begin()+i);
+        std::copy(row, row+w, ws.padded.begin()+n+i);
+        std::fill(ws.index.begin()+i, ws.index.begin()+i+w, (LsShape*)0);
+    }
+    padded.nrow = h;
+    padded.ncol = stride;
+    padded.gray = &ws.padded[stride+1];
+    padded.padded = true;
+
+    Edgel e(0, 0, SOUTH);
+    ws.bound.clear();
+    walk_line<LsShape::SUP>(im, e, -1, ws.bound);
+    ws.bound.push_back(e);
+}
+
 /// Top-down pre-order FLST algorithm. Private pixels are found before children
-/// are built.
-void LsTree::flst_td_pre(const unsigned char* gray) {
-    cimage image = {nrow, ncol, (unsigned char*)gray};
+/// are built. Level lines are stored according to \a options.contour. The
+/// scratch buffers are taken from \a ws. Subtrees are extracted in parallel by
+/// \a options.nThreads threads (0 for all available), keeping the same result.
+/// Only shapes of area in [\a options.minArea,\a options.maxArea] and of
+/// contrast with their parent above \a options.tolerance are kept, others
+/// being pruned during the descent. With a budget of shapes or time, see
+/// \c expand, in lazy mode only the root and its children are extracted, see
+/// \c develop. Otherwise, if \a options.padded, the extraction works in a
+/// padded copy of the image, with the same frame for \c smallestShape; field
+/// \c bBoundary is then set from the pixels of the border. Similarly, if
+/// \a options.runs, private areas are explored by runs, see \c find_pp_runs.
+void LsTree::flst_td_pre(const unsigned char* gray, const Options& options,
+                         LsWorkspace& ws) {
+    LsImage image = {nrow, ncol, (unsigned char*)gray, false, false};
     int area = ncol * nrow;
 
     for(int i = area-1; i >= 0; i--)
         smallestShape[i] = 0;
 
+    if(options.lazy || options.maxShapes>0 || options.maxTime>0) { // Pending
+        Pending root = {0, {0,0}, SOUTH, false, area, 0};
+        pending.assign(1, root);
+        expand(gray, options, 0, -1, ws);
+        return;
+    }
+
+    int nThreads = options.nThreads;
+    LsKeep keep = {options.minArea,
+                   (options.maxArea>0)? options.maxArea: area,
+                   options.tolerance};
+#ifdef _OPENMP
+    if(nThreads <= 0)
+        nThreads = omp_get_max_threads();
+#else
+    nThreads = 1;
+#endif
+
+    LsShape** index = smallestShape;
+    if(options.padded) {
+        LsImage padded;
+        pad(&image, shapes, ws, padded);
+        image = padded;
+        smallestShape = &ws.index[image.ncol+1];
+    }
+    image.runs = options.runs;
+
     shapes[0].type = LsShape::SUP;
-    shapes[0].pixels = new LsPoint[area];
-    Edgel e(0, 0, SOUTH);
-    create_tree(&image, *this, shapes[0], e, -1);
+    switch(options.contour) {
+    case NO_CONTOUR:
+        flst_td_pre<NO_CONTOUR>(&image, ws, nThreads, keep);
+        break;
+    case CONTOUR_POINTS:
+        flst_td_pre<CONTOUR_POINTS>(&image, ws, nThreads, keep);
+        break;
+    case CONTOUR_CHAIN:
+        flst_td_pre<CONTOUR_CHAIN>(&image, ws, nThreads, keep);
+        break;
+    default:
+        flst_td_pre<CONTOUR_POINTS|CONTOUR_CHAIN>(&image, ws, nThreads, keep);
+    }
     assert(area == shapes[0].area);
+
+    if(image.padded) { // Back to the index without frame
+        for(int y=0; y<nrow; y++) {
+            LsShape** row = smallestShape + y*image.ncol;
+            std::copy(row, row+ncol, index+y*ncol);
+        }
+        smallestShape = index;
+        mark_border(); // Not set by the extraction in padded image
+    }
+}
+
+/// Extract child \a p of \c pending, put back in \c pending its own children,
+/// whose pixels are reserved: after the private pixels of the shape, its
+/// children are by increasing area. They are pushed on the heap, unless in
+/// \a lazy mode. Only shapes satisfying \a keep are kept.
+template <int C>
+void LsTree::extract_pending(Cimage im, const Pending& p, LsWorkspace& ws,
+                             const LsKeep& keep, bool lazy) {
+    LsShape* s = p.parent? add_child(*p.parent): shapes;
+    s->pixels = shapes[0].pixels + p.offset;
+    if(p.merged) { // Free its pixels again
+        for(int i=0; i<p.area; i++)
+            smallestShape[s->pixels[i].y*ncol+s->pixels[i].x] = 0;
+        if(p.parent) // It may no longer meet the border, see expand
+            p.parent->bBoundary = false;
+    }
+    Edgel e(p.pt, p.dir);
+    init_shape<C>(im, *this, *s, e, p.parent? seed_level(im,e): -1, 0, ws);
+    find_pp_children(im, *this, *s, 0, ws);
+    prune_children(im, *this, *s, 0, keep, ws);
+    size_t begin = pending.size();
+    if(lazy) { // See develop
+        assert((int)pendingStart.size() == iNbShapes-1);
+        pendingStart.push_back(begin);
+    }
+    for(size_t i=0; i<ws.seeds.size(); i++) {
+        Pending c = {s, ws.seeds[i].pt, ws.seeds[i].dir, false,
+                     ws.seedArea[i], 0};
+        pending.push_back(c);
+    }
+    std::sort(pending.begin()+begin, pending.end()); // By area
+    int offset = p.offset + s->area;
+    for(size_t i=begin; i<pending.size(); i++) {
+        pending[i].offset = offset;
+        offset += pending[i].area;
+        if(! lazy)
+            std::push_heap(pending.begin(), pending.begin()+i+1);
+    }
+    assert(offset == p.offset+p.area);
+    s->area = p.area;
+    ws.seeds.clear();
+    ws.seedArea.clear();
+    ws.seedGray.clear();
+    ws.seedLine.clear();
+    ws.seedLines.clear();
+}
+
+/// Put the pixels of the children of \c pending from index \a begin not yet
+/// merged in the private pixels of their parent, in their reserved range.
+void LsTree::merge_pending(Cimage im, LsWorkspace& ws, size_t begin) {
+    for(size_t i=begin; i<pending.size(); i++) {
+        Pending& p = pending[i];
+        if(! p.merged)
+            merge_child(im, *this, *p.parent, Edgel(p.pt, p.dir), 0,
+                        shapes[0].pixels+p.offset, ws);
+        p.merged = true;
+    }
+}
+
+/// Extract shapes by decreasing area from the heap \c pending of children not
+/// extracted, until \a maxShapes shapes are extracted or \a maxTime seconds
+/// have elapsed on the wall clock, at least one in any case (0 for no limit).
+/// As the children not extracted are the smallest ones, their pixels and the
+/// private pixels of their parent are contiguous. Only shapes satisfying
+/// \a keep are kept. Return the number of extracted shapes.
+template <int C>
+int LsTree::expand_budget(Cimage im, LsWorkspace& ws, const LsKeep& keep,
+                          int maxShapes, double maxTime) {
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point start = Clock::now();
+    int n = 0;
+    while(! pending.empty()) {
+        if(n>0 && maxShapes>0 && n>=maxShapes)
+            break;
+        if(n>0 && maxTime>0 &&
+           std::chrono::duration<double>(Clock::now()-start).count()>=maxTime)
+            break;
+        std::pop_heap(pending.begin(), pending.end());
+        Pending p = pending.back();
+        pending.pop_back();
+        extract_pending<C>(im, p, ws, keep, false);
+        ++n;
+    }
+    return n;
+}
+
+/// Extract the children of shape \a s in \c pending, but not their own
+/// children, or the root if \a s is null, in lazy mode. The children of a
+/// shape follow the ones of the previous shape in \c pending, from index
+/// \c pendingStart. Only shapes satisfying \a keep are kept. Return the
+/// number of extracted shapes.
+template <int C>
+int LsTree::develop(Cimage im, LsWorkspace& ws, const LsKeep& keep,
+                    LsShape* s) {
+    size_t begin=0, end=1; // Root
+    if(s) {
+        size_t i = shape_index(s);
+        begin = pendingStart[i];
+        end = (i+1<pendingStart.size())? pendingStart[i+1]: pending.size();
+    }
+    for(size_t i=begin; i<end; i++) {
+        Pending p = pending[i]; // Copy, as pending grows
+        extract_pending<C>(im, p, ws, keep, true);
+        pending[i].merged = true; // Not to be merged by expand
+    }
+    nPendingExtracted += end-begin;
+    return (int)(end-begin);
+}
+
+/// Smallest shape of \a tree containing \a pixel, whose children may be in
+/// \c pending without being merged. Inside such a child, the pixels are free
+/// up to its boundary, marked as its parent by \c find_child.
+static LsShape* extracted_shape(const LsTree& tree, int pixel) {
+    while(! tree.smallestShape[pixel]) {
+        assert(pixel%tree.ncol != 0); // Not before start of row
+        --pixel;
+    }
+    return tree.smallestShape[pixel];
+}
+
+/// Extract children of \c pending: in lazy mode, the children of \a s, or the
+/// root and its children if \a s is null, otherwise within the budget of
+/// \a options. If \a pixel is not negative, the children of the new child of
+/// \a s containing it are extracted in turn, down to its smallest shape. The
+/// pixels of the new children are then put in their parent, once for all
+/// levels, and field \c bBoundary is set again from the border. Only shapes
+/// satisfying \a keep are kept. Return the number of extracted shapes.
+template <int C>
+int LsTree::expand(Cimage im, LsWorkspace& ws, const LsKeep& keep,
+                   const Options& options, LsShape* s, int pixel) {
+    size_t begin = options.lazy? pending.size(): 0; // Heap otherwise
+    int n = 0;
+    if(! options.lazy)
+        n = expand_budget<C>(im, ws, keep, options.maxShapes, options.maxTime);
+    else {
+        if(! s) { // Root
+            n = develop<C>(im, ws, keep, 0);
+            s = shapes;
+        }
+        while(true) {
+            n += develop<C>(im, ws, keep, s);
+            if(pixel < 0)
+                break;
+            LsShape* c = extracted_shape(*this, pixel);
+            if(c == s)
+                break;
+            s = c;
+        }
+    }
+    merge_pending(im, ws, begin);
+    mark_border(); // For parents of extracted children that were merged
+    return n;
+}
+
+/// Extraction of the children of \c pending according to \a options, see
+/// Options::maxShapes and Options::lazy, and to \a s and \a pixel in lazy
+/// mode. Return the number of extracted shapes.
+int LsTree::expand(const unsigned char* gray, const Options& options,
+                   LsShape* s, int pixel, LsWorkspace& ws) {
+    LsImage image = {nrow, ncol, (unsigned char*)gray, false, false};
+    int area = ncol * nrow;
+    LsKeep keep = {options.minArea,
+                   (options.maxArea>0)? options.maxArea: area,
+                   options.tolerance};
+    switch(options.contour) {
+    case NO_CONTOUR:
+        return expand<NO_CONTOUR>(&image, ws, keep, options, s, pixel);
+    case CONTOUR_POINTS:
+        return expand<CONTOUR_POINTS>(&image, ws, keep, options, s, pixel);
+    case CONTOUR_CHAIN:
+        return expand<CONTOUR_CHAIN>(&image, ws, keep, options, s, pixel);
+    default:
+        return expand<CONTOUR_POINTS|CONTOUR_CHAIN>(&image, ws, keep,
+                                                    options, s, pixel);
+    }
+}
+
+/// The interface of LsTree used by the extraction, for the grain filter.
+/// Shapes are not stored and no level line is traced.
+struct LsGrain {
+    LsShape** smallestShape; ///< Shape of each pixel
+    std::vector<LsPoint> contours; ///< Unused
+    std::vector<size_t> contourStart; ///< Unused
+    LsChainCodes chains; ///< Unused
+};
+
+/// Push shape \a s of edgel \a e and boundary \a line, whose parent is at
+/// \a level, and write the gray level of its private pixels in \a out. Its
+/// children not satisfying \a keep are merged with it.
+static void push_grain(Cimage im, LsGrain& g, LsShape& s, const Edgel& e,
+                       int level, const Edgel* line, const LsKeep& keep,
+                       unsigned char* out, LsWorkspace& ws) {
+    push_shape<LsTree::NO_CONTOUR>(im, g, s, e, level, line, keep, ws);
+    for(int i=0; i<s.area; i++)
+        out[s.pixels[i].y*im->ncol+s.pixels[i].x] = s.gray;
+}
+
+/// Grain filter of image \a gray of size \a w x \a h into \a out: each pixel
+/// takes the gray level of its smallest shape of area at least \a minArea.
+/// The result is the image of the tree extracted with this minimum area, but
+/// the descent of TD_PRE writes it directly: shapes are records reused at
+/// each depth and their private pixels share one buffer, since the pixels are
+/// written as soon as they are found. Scratch buffers are taken from
+/// \a workspace if not null.
+void grain_filter(const unsigned char* gray, int w, int h, int minArea,
+                  unsigned char* out, LsWorkspace* workspace) {
+    int n = w*h;
+    if(minArea <= 1) {
+        std::copy(gray, gray+n, out);
+        return;
+    }
+    LsWorkspace tmp;
+    LsWorkspace& ws = workspace? *workspace: tmp;
+    ws.index.assign(n, 0);
+    ws.grain.resize(n);
+    LsImage image = {h, w, (unsigned char*)gray, false, false};
+    LsGrain g;
+    g.smallestShape = &ws.index[0];
+    LsKeep keep = {minArea, n, 0};
+
+    std::deque<LsShape> shapes(1); // Shape at each depth
+    shapes[0].parent = 0;
+    shapes[0].pixels = &ws.grain[0];
+    std::vector<LsWorkspace::PreFrame>& frames = ws.preFrames;
+    push_grain(&image, g, shapes[0], Edgel(0, 0, SOUTH), -1, 0, keep, out,
+               ws);
+    while(! frames.empty()) {
+        LsWorkspace::PreFrame& f = frames.back();
+        if(f.next == f.end) { // All children built
+            pop_shape(ws);
+            continue;
+        }
+        LsShape& s = *f.s;
+        int i = (int)f.next++;
+        Edgel seed = ws.seeds[i];
+        if(frames.size() == shapes.size())
+            shapes.push_back(LsShape());
+        LsShape& child = shapes[frames.size()];
+        child.parent = &s;
+        child.pixels = s.pixels; // Those of s are already written
+        push_grain(&image, g, child, seed, seed_level(&image,seed),
+                   seed_line(ws,i), keep, out, ws);
+    }
+    ws.clear();
 }
@@ -0,0 +1,558 @@
+/**
+ * SPDX-License-Identifier: MPL-2.0+
+ * @file flst_classic.cpp
+ * @brief Classical FLST, growing regions from local extrema
+ * @author Pascal Monasse <monasse@imagine.enpc.fr>
+ *
+ * Copyright (c) 2024 Pascal Monasse
+ * All rights reserved.
+ */
+
+#include "nodes.h"
+#include <cassert>
+
+/// Directions of separation between a pixel and its upper and left neighbors
+/// in the frontier of a region. The diagonal ones are not directions of
+/// frontiers, but tell whether diagonal pixels are in the region when
+/// counting the connected components of the frontier.
+enum {UP=1, UPLEFT=2, LEFT=4, LEFTDOWN=8,
+      DOWN=16, DOWNRIGHT=32, RIGHT=64, RIGHTUP=128};
+
+/// Classical FLST [Monasse-Guichard 2000]. A region is grown from each local
+/// extremum by adding its neighbors of the nearest gray level. It is a shape
+/// when it has no hole and its neighbors are all above or all below its
+/// level. The region is then flattened at the level of its neighbors, so that
+/// the shapes containing it are found from another extremum. All the state of
+/// an extraction is here, the buffers being in the workspace, so that
+/// extractions can run concurrently.
+class ClassicFlst {
+public:
+    ClassicFlst(const unsigned char* gray, int w, int h,
+                int minArea, int maxArea, bool trace, LsWorkspace& ws);
+    void scan_levels();
+private:
+    const unsigned char* gray; ///< Input image
+    int w, h; ///< Dimensions of image
+    int minArea, maxArea; ///< Range of area of shapes in the tree
+    int exploration; ///< Index of current exploration (local extremum)
+    bool meetBorder; ///< Does the region meet the border?
+    bool trace; ///< Trace level lines of shapes?
+    bool rootLevel; ///< Is the level of the root known?
+    /// Change in number of connected components of the frontier of the
+    /// region for a configuration of the frontier around the added pixel,
+    /// region in 4- or 8-connectivity.
+    int pattern4[256], pattern8[256];
+    LsWorkspace& ws; ///< Buffers
+    std::vector<int>& largest; ///< Largest shape (node) containing pixels
+
+    // Neighbors of the region, linked by gray level
+    int nNeighbors; ///< Number of neighbors
+    int nFree; ///< Number of free places in ws.neighbors
+    int occupation[256]; ///< Number of neighbors at each gray level
+    int firstNeighbor[256], lastNeighbor[256]; ///< Index in ws.neighbors
+    unsigned char minLevel, maxLevel; ///< Extremal levels of neighbors
+
+    void init_patterns();
+    bool is_local_min(int x, int y, bool connect8) const;
+    bool is_local_max(int x, int y, bool connect8) const;
+    void reinit_neighborhood();
+    void add_neighbor(int x, int y);
+    void delete_neighbors(unsigned char level, int n);
+    void add_point4(int x, int y, int& nFrontier);
+    void add_point8(int x, int y, int& nFrontier);
+    void create_shape(int area, unsigned char level, LsShape::Type type,
+                      bool connect8);
+    void trace_line(int first, bool connect8);
+    bool add_iso_level(int& area, unsigned char level, int& nFrontier,
+                       bool& connect8);
+    void find_levels(int x, int y, bool connect8);
+};
+
+/// Constructor. Only shapes of area in [minArea,maxArea] are kept. Their
+/// level lines are traced if \a trace. Regions still grow beyond maxArea, as
+/// the level of the root is found by a region meeting the border that exceeds
+/// half the image.
+ClassicFlst::ClassicFlst(const unsigned char* gray, int w, int h,
+                         int minArea, int maxArea, bool trace,
+                         LsWorkspace& ws)
+: gray(gray), w(w), h(h), minArea(minArea), maxArea(maxArea),
+  exploration(1), meetBorder(false),
+  trace(trace), rootLevel(false), ws(ws), largest(ws.zpar) {
+    int n = w*h;
+    ws.image.assign(gray, gray+n);
+    ws.visited.assign(n, 0);
+    ws.neighbor.assign(n, 0);
+    LsWorkspace::Frontier f = {0, 0};
+    ws.frontier.assign(n, f);
+    ws.region.resize(n);
+    ws.neighbors.resize(n);
+    ws.freeNeighbors.resize(n);
+    largest.assign(n, 0);
+    ws.component.assign(n, 0);
+    LsWorkspace::UfNode root = {-1, -1, -1, 0, 0, gray[0], LsShape::SUP,
+                                n, 0};
+    ws.nodes.assign(1, root);
+    if(trace) {
+        ws.mask.assign(n, 0);
+        ws.lineStart.assign(2, 0); // Root traced at the end
+    }
+    init_patterns();
+}
+
+/// Fill the tables of changes in number of connected components of the
+/// frontier.
+void ClassicFlst::init_patterns() {
+    std::fill(pattern4, pattern4+256, 0);
+    std::fill(pattern8, pattern8+256, 0);
+    // Region in 4-connectivity, complement in 8-connectivity
+    for(int i=0; i<256; i++) {
+        int c = i & (UP|LEFT|DOWN|RIGHT);
+        if(c == (UP|LEFT|DOWN|RIGHT)) {
+            pattern4[i] = -1;
+            if(i & UPLEFT)    ++pattern4[i];
+            if(i & LEFTDOWN)  ++pattern4[i];
+            if(i & DOWNRIGHT) ++pattern4[i];
+            if(i & RIGHTUP)   ++pattern4[i];
+        } else if(c == (UP|LEFT|DOWN)) {
+            if(i & UPLEFT)    pattern4[i] = 1;
+            if(i & LEFTDOWN)  ++pattern4[i];
+        } else if(c == (LEFT|DOWN|RIGHT)) {
+            if(i & LEFTDOWN)  pattern4[i] = 1;
+            if(i & DOWNRIGHT) ++pattern4[i];
+        } else if(c == (DOWN|RIGHT|UP)) {
+            if(i & DOWNRIGHT) pattern4[i] = 1;
+            if(i & RIGHTUP)   ++pattern4[i];
+        } else if(c == (RIGHT|UP|LEFT)) {
+            if(i & RIGHTUP)   pattern4[i] = 1;
+            if(i & UPLEFT)    ++pattern4[i];
+        } else if(c==(UP|DOWN) || c==(RIGHT|LEFT))
+            pattern4[i] = 1;
+        else if((c==(UP|LEFT)     && (i&UPLEFT))   ||
+                (c==(LEFT|DOWN)   && (i&LEFTDOWN)) ||
+                (c==(DOWN|RIGHT)  && (i&DOWNRIGHT))||
+                (c==(RIGHT|UP)    && (i&RIGHTUP)))
+            pattern4[i] = 1;
+    }
+    // Region in 8-connectivity, complement in 4-connectivity
+    for(int i=0; i<256; i++) {
+        int c = i & (UP|LEFT|DOWN|RIGHT);
+        if(c == (UP|LEFT|DOWN|RIGHT))
+            pattern8[i] = -1;
+        else if(c==(UP|DOWN) || c==(RIGHT|LEFT))
+            pattern8[i] = 1;
+        else if(c == LEFT) {
+            if(i & DOWNRIGHT) pattern8[i] = 1;
+            if(i & RIGHTUP)   ++pattern8[i];
+        } else if(c == DOWN) {
+            if(i & RIGHTUP)   pattern8[i] = 1;
+            if(i & UPLEFT)    ++pattern8[i];
+        } else if(c == RIGHT) {
+            if(i & UPLEFT)    pattern8[i] = 1;
+            if(i & LEFTDOWN)  ++pattern8[i];
+        } else if(c == UP) {
+            if(i & LEFTDOWN)  pattern8[i] = 1;
+            if(i & DOWNRIGHT) ++pattern8[i];
+        } else if((c==(UP|LEFT)     && (i&DOWNRIGHT)) ||
+                  (c==(LEFT|DOWN)   && (i&RIGHTUP))   ||
+                  (c==(DOWN|RIGHT)  && (i&UPLEFT))    ||
+                  (c==(RIGHT|UP)    && (i&LEFTDOWN)))
+            pattern8[i] = 1;
+        else if(c == 0) { // Pixels of the region only in diagonal directions
+            pattern8[i] = -1;
+            if(i & UPLEFT)    ++pattern8[i];
+            if(i & LEFTDOWN)  ++pattern8[i];
+            if(i & DOWNRIGHT) ++pattern8[i];
+            if(i & RIGHTUP)   ++pattern8[i];
+            if(pattern8[i] == -1) // First pixel of the region
+                pattern8[i] = 0;
+        }
+    }
+}
+
+/// Is pixel (\a x,\a y) a strict local minimum of the simplified image, among
+/// its 4- or 8-neighbors (\a connect8)?
+bool ClassicFlst::is_local_min(int x, int y, bool connect8) const {
+    const unsigned char* p = &ws.image[y*w+x];
+    bool strict = false;
+    for(int dy=-1; dy<=1; dy++)
+        for(int dx=-1; dx<=1; dx++) {
+            if((dx==0 && dy==0) || (!connect8 && dx!=0 && dy!=0) ||
+               x+dx<0 || x+dx>=w || y+dy<0 || y+dy>=h)
+                continue;
+            unsigned char v = p[dy*w+dx];
+            if(v < *p)
+                return false;
+            strict = strict || v>*p;
+        }
+    return strict;
+}
+
+/// Is pixel (\a x,\a y) a strict local maximum of the simplified image, among
+/// its 4- or 8-neighbors (\a connect8)?
+bool ClassicFlst::is_local_max(int x, int y, bool connect8) const {
+    const unsigned char* p = &ws.image[y*w+x];
+    bool strict = false;
+    for(int dy=-1; dy<=1; dy++)
+        for(int dx=-1; dx<=1; dx++) {
+            if((dx==0 && dy==0) || (!connect8 && dx!=0 && dy!=0) ||
+               x+dx<0 || x+dx>=w || y+dy<0 || y+dy>=h)
+                continue;
+            unsigned char v = p[dy*w+dx];
+            if(v > *p)
+                return false;
+            strict = strict || v<*p;
+        }
+    return strict;
+}
+
+/// Empty the neighborhood for a new region.
+void ClassicFlst::reinit_neighborhood() {
+    nNeighbors = nFree = 0;
+    std::fill(occupation, occupation+256, 0);
+    minLevel = 255;
+    maxLevel = 0;
+}
+
+/// Add pixel (\a x,\a y) to the neighbors of the region.
+void ClassicFlst::add_neighbor(int x, int y) {
+    ws.neighbor[y*w+x] = exploration;
+    unsigned char level = ws.image[y*w+x];
+    minLevel = std::min(minLevel, level);
+    maxLevel = std::max(maxLevel, level);
+    int i = (nFree>0)? ws.freeNeighbors[--nFree]: nNeighbors;
+    ++nNeighbors;
+    LsPoint p = {(short int)x, (short int)y};
+    ws.neighbors[i].point = p;
+    if(occupation[level]++ == 0)
+        firstNeighbor[level] = i;
+    else
+        ws.neighbors[lastNeighbor[level]].next = i;
+    lastNeighbor[level] = i;
+}
+
+/// Remove the first \a n neighbors at gray level \a level, now in the region.
+void ClassicFlst::delete_neighbors(unsigned char level, int n) {
+    int i = firstNeighbor[level];
+    nNeighbors -= n;
+    occupation[level] -= n;
+    for(; n>0; n--, i=ws.neighbors[i].next)
+        ws.freeNeighbors[nFree++] = i;
+    if(occupation[level] != 0)
+        firstNeighbor[level] = i;
+    else {
+        if(level == minLevel)
+            while(occupation[minLevel] == 0)
+                ++minLevel;
+        if(level == maxLevel)
+            while(occupation[maxLevel] == 0)
+                --maxLevel;
+    }
+}
+
+/// Add pixel (\a x,\a y) to the region in 4-connectivity. Update the frontier
+/// and its number of connected components \a nFrontier, 1 plus the number of
+/// holes. The complement being in 8-connectivity, diagonal pixels matter.
+void ClassicFlst::add_point4(int x, int y, int& nFrontier) {
+    LsWorkspace::Frontier* f = &ws.frontier[y*w+x];
+    unsigned char pattern = 0;
+    if(meetBorder) {
+        if(y == 0) pattern |= LEFT;
+        if(x == 0) pattern |= DOWN;
+    }
+    if(f->exploration < exploration) {
+        f->exploration = exploration;
+        f->directions = 0;
+        if(x != 0) f->directions |= UP;
+        if(y != 0) f->directions |= RIGHT;
+    } else {
+        pattern |= f->directions & (LEFT|DOWN);
+        if(f->directions & LEFT)
+            f->directions -= LEFT;
+        else if(y != 0)
+            f->directions |= RIGHT;
+        if(f->directions & DOWN)
+            f->directions -= DOWN;
+        else if(x != 0)
+            f->directions |= UP;
+    }
+
+    if(x == w-1) {
+        if(meetBorder) pattern |= UP;
+    } else if(f[1].exploration < exploration) {
+        f[1].exploration = exploration;
+        f[1].directions = DOWN;
+    } else {
+        pattern |= f[1].directions & UP;
+        if(f[1].directions & RIGHT)
+            pattern |= UPLEFT;
+        if(f[1].directions & UP)
+            f[1].directions -= UP;
+        else
+            f[1].directions |= DOWN;
+    }
+
+    if(y == h-1) {
+        if(meetBorder) pattern |= RIGHT;
+    } else if(f[w].exploration < exploration) {
+        f[w].exploration = exploration;
+        f[w].directions = LEFT;
+    } else {
+        pattern |= f[w].directions & RIGHT;
+        if(f[w].directions & UP)
+            pattern |= DOWNRIGHT;
+        if(f[w].directions & RIGHT)
+            f[w].directions -= RIGHT;
+        else
+            f[w].directions |= LEFT;
+    }
+
+    if(x>0 && f[-1].exploration==exploration && (f[-1].directions & RIGHT))
+        pattern |= LEFTDOWN;
+    if(y<h-1 && x<w-1 && f[w+1].exploration==exploration &&
+       (f[w+1].directions & DOWN))
+        pattern |= RIGHTUP;
+    nFrontier += pattern4[pattern];
+    if(x==0 || x==w-1 || y==0 || y==h-1)
+        meetBorder = true;
+}
+
+/// Add pixel (\a x,\a y) to the region in 8-connectivity. Update the frontier
+/// and its number of connected components \a nFrontier, 1 plus the number of
+/// holes.
+void ClassicFlst::add_point8(int x, int y, int& nFrontier) {
+    LsWorkspace::Frontier* f = &ws.frontier[y*w+x];
+    unsigned char pattern = 0;
+    if(meetBorder) {
+        if(y == 0) pattern |= LEFT;
+        if(x == 0) pattern |= DOWN;
+    }
+    if(f->exploration < exploration) {
+        f->exploration = exploration;
+        f->directions = 0;
+        if(x != 0) f->directions |= UP;
+        if(y != 0) f->directions |= RIGHT;
+    } else {
+        pattern |= f->directions & (LEFT|DOWN);
+        if(f->directions & LEFT)
+            f->directions -= LEFT;
+        else if(y != 0)
+            f->directions |= RIGHT;
+        if(f->directions & DOWN)
+            f->directions -= DOWN;
+        else if(x != 0)
+            f->directions |= UP;
+    }
+
+    if(x == w-1) {
+        if(meetBorder) pattern |= UP;
+    } else if(f[1].exploration < exploration) {
+        f[1].exploration = exploration;
+        f[1].directions = DOWN;
+    } else {
+        pattern |= f[1].directions & UP;
+        if(f[1].directions & LEFT)
+            pattern |= UPLEFT;
+        if(f[1].directions & UP)
+            f[1].directions -= UP;
+        else
+            f[1].directions |= DOWN;
+    }
+
+    if(y == h-1) {
+        if(meetBorder) pattern |= RIGHT;
+    } else if(f[w].exploration < exploration) {
+        f[w].exploration = exploration;
+        f[w].directions = LEFT;
+    } else {
+        pattern |= f[w].directions & RIGHT;
+        if(f[w].directions & DOWN)
+            pattern |= DOWNRIGHT;
+        if(f[w].directions & RIGHT)
+            f[w].directions -= RIGHT;
+        else
+            f[w].directions |= LEFT;
+    }
+
+    if(x>0 && f[-1].exploration==exploration && (f[-1].directions & LEFT))
+        pattern |= LEFTDOWN;
+    if(y<h-1 && x<w-1 && f[w+1].exploration==exploration &&
+       (f[w+1].directions & UP))
+        pattern |= RIGHTUP;
+    nFrontier += pattern8[pattern];
+    if(x==0 || x==w-1 || y==0 || y==h-1)
+        meetBorder = true;
+}
+
+/// Create a shape from the region of area \a area, of gray level \a level
+/// and connectivity 8 if \a connect8, else 4. It becomes the parent of the
+/// largest shapes containing its pixels.
+void ClassicFlst::create_shape(int area, unsigned char level,
+                               LsShape::Type type, bool connect8) {
+    std::vector<LsWorkspace::UfNode>& nodes = ws.nodes;
+    int s = (int)nodes.size();
+    LsWorkspace::UfNode n = {0, -1, nodes[0].child, 0, 0, level, type,
+                             w*h, 0};
+    nodes.push_back(n);
+    nodes[0].child = s;
+    int first = w*h;
+    for(int i=area-1; i>=0; i--) {
+        int p = ws.region[i].y*w + ws.region[i].x;
+        first = std::min(first, p);
+        int c = largest[p];
+        if(c == 0)
+            ws.component[p] = s;
+        else if(nodes[c].parent != s) { // Move c from root to s
+            int prev = nodes[0].child; // Not c, since s comes first
+            while(nodes[prev].sibling != c)
+                prev = nodes[prev].sibling;
+            nodes[prev].sibling = nodes[c].sibling;
+            nodes[c].parent = s;
+            nodes[c].sibling = nodes[s].child;
+            nodes[s].child = c;
+        }
+        largest[p] = s;
+    }
+    if(trace)
+        trace_line(first, connect8);
+}
+
+/// Trace in \c ws.lines the boundary of the region, without hole, from its
+/// first pixel \a first in raster order. The region is marked in \c ws.mask
+/// and is connected in 8-connectivity if \a connect8, else 4. Its pixels may
+/// be on both sides of its level near the border of the image, so that its
+/// level line is not traced in the image.
+void ClassicFlst::trace_line(int first, bool connect8) {
+    LsImage mask = {h, w, &ws.mask[0], false, false};
+    LsPoint p = {(short int)(first%w), (short int)(first/w)};
+    Edgel e(p, WEST), cur=e;
+    do {
+        ws.lines.push_back(cur);
+        cur.next(&mask, LsShape::SUP, 0, connect8? 8: 4);
+    } while(cur != e);
+    ws.lineStart.push_back(ws.lines.size());
+}
+
+/// Add to the region of area \a area its neighbors of gray level \a level,
+/// unless the region meets the border and would exceed half the image: this is
+/// the level of the root. \a nFrontier is the number of connected components
+/// of its frontier, \a connect8 its connectivity. Return whether the
+/// neighbors were added.
+bool ClassicFlst::add_iso_level(int& area, unsigned char level,
+                                int& nFrontier, bool& connect8) {
+    int n = occupation[level];
+    if(meetBorder && area+n > w*h/2) { // Level of root found
+        ws.nodes[0].gray = level;
+        rootLevel = true;
+        return false;
+    }
+    // 4-neighbors, then diagonal ones
+    static const int dx[8] = {-1, 1, 0, 0, -1, 1, 1, -1};
+    static const int dy[8] = {0, 0, -1, 1, -1, -1, 1, 1};
+    int i = firstNeighbor[level];
+    for(int k=0; k<n; k++, i=ws.neighbors[i].next) {
+        int x=ws.neighbors[i].point.x, y=ws.neighbors[i].point.y;
+        ws.region[area+k] = ws.neighbors[i].point;
+        if(connect8)
+            add_point8(x, y, nFrontier);
+        else
+            add_point4(x, y, nFrontier);
+        ws.visited[y*w+x] = exploration;
+        if(trace)
+            ws.mask[y*w+x] = 1;
+        for(int j=0; j<8; j++) {
+            if(j == 4) { // Diagonal neighbors in 8-connectivity only
+                if(minLevel < level)
+                    connect8 = true;
+                if(! connect8)
+                    break;
+            }
+            int xn=x+dx[j], yn=y+dy[j];
+            if(0<=xn && xn<w && 0<=yn && yn<h &&
+               ws.neighbor[yn*w+xn] < exploration)
+                add_neighbor(xn, yn);
+        }
+    }
+    area += n;
+    delete_neighbors(level, n);
+    return true;
+}
+
+/// Grow a region from local extremum (\a x,\a y), in 8-connectivity if
+/// \a connect8 (maximum), and create the shapes found. The region is then
+/// set at the level of its neighbors in the simplified image.
+void ClassicFlst::find_levels(int x, int y, bool connect8) {
+    unsigned char level = ws.image[y*w+x];
+    unsigned char lo=level, hi=level; // Extremal levels of neighbors
+    int area=0, previousArea=0;
+    int nFrontier = 1; // Connected components of frontier, 1 + #holes
+    bool ambiguous = false; // Region at level of all its neighbors
+    meetBorder = false;
+    reinit_neighborhood();
+    add_neighbor(x, y);
+    do {
+        if(! add_iso_level(area, level, nFrontier, connect8))
+            break;
+        lo = minLevel;
+        hi = maxLevel;
+        if(ambiguous && (lo!=level || hi!=level)) {
+            ambiguous = false;
+            nFrontier = 1;
+        }
+        if(lo>level || hi<level) {
+            if(nFrontier > 1) // The region has holes
+                break;
+            previousArea = area;
+            if(minArea<=area && area<=maxArea)
+                create_shape(area, level,
+                             (level<lo)? LsShape::INF: LsShape::SUP, connect8);
+            level = (lo>level)? lo: hi;
+            if(lo == hi) {
+                connect8 = false;
+                ambiguous = true;
+            }
+        }
+    } while(lo>=level || hi<=level);
+    for(int i=previousArea-1; i>=0; i--)
+        ws.image[ws.region[i].y*w + ws.region[i].x] = level;
+    if(trace)
+        for(int i=area-1; i>=0; i--)
+            ws.mask[ws.region[i].y*w + ws.region[i].x] = 0;
+}
+
+/// Grow regions from all local extrema in raster order, in 4-connectivity for
+/// minima and 8-connectivity for maxima. If no region meeting the border
+/// reached half the image, the root takes the level of its private pixels.
+void ClassicFlst::scan_levels() {
+    for(int y=0; y<h; y++)
+        for(int x=0; x<w; x++)
+            if(ws.visited[y*w+x] == 0) {
+                bool connect8 = false;
+                if(is_local_min(x, y, false) ||
+                   (connect8 = is_local_max(x, y, true))) {
+                    find_levels(x, y, connect8);
+                    ++exploration;
+                }
+            }
+    for(int i=0; i<w*h && !rootLevel; i++)
+        if(ws.component[i] == 0) {
+            ws.nodes[0].gray = gray[i];
+            rootLevel = true;
+        }
+}
+
+/// Classical FLST, only keeping shapes of area in
+/// [options.minArea,options.maxArea]. The pixels of other shapes go to their
+/// nearest kept ancestor. The scratch buffers are taken from \a ws.
+void LsTree::flst_classic(const unsigned char* gray, const Options& options,
+                          LsWorkspace& ws) {
+    int minArea = std::max(options.minArea, 1);
+    int maxArea = (options.maxArea>0)? options.maxArea: ncol*nrow;
+    bool trace = (options.contour != NO_CONTOUR);
+    ClassicFlst flst(gray, ncol, nrow, minArea, maxArea, trace, ws);
+    flst.scan_levels();
+
+    count_pixels(ws);
+    LsImage image = {nrow, ncol, (unsigned char*)gray, false, false};
+    create_shapes(&image, *this, ws, options.contour);
+    assert(ncol*nrow == shapes[0].area);
+}
@@ -8,9 +8,8 @@
  * All rights reserved.
  */
 
-#include "edgel.h"
-#include "tree.h"
-#include <stack>
+#include "contour.h"
+#include <cstdlib>
 
 /// Fix initial edgel to be one of 4 cardinal directions.
 /// level must be strictly between the gray levels of e.pt and e's exterior.
@@ -32,11 +31,33 @@ static void fix_initial_edgel(Cimage im, LsShape::Type t, Edgel& e, int level) {
     }
 }
 
-/// Find largest shape \a s with boundary containing \a e. Return this boundary
-/// as a sequence of edgels. \a level is the gray level of the parent.
-/// Fields \c pixels, \c parent, \c sibling and \c child are not set.
-static std::vector<Edgel> locate_line(Cimage im, LsShape& s,
-                                      Edgel e, int level) {
+/// Follow the boundary of shape \a s of type \a t from its edgel \a e, see
+/// \c locate_line.
+template <LsShape::Type t>
+static int walk_line(Cimage im, LsShape& s,
+                     const Edgel& e, int level, std::vector<Edgel>& boundary) {
+    int area = 0; // Integral of x dy along the boundary
+    Edgel cur = e;
+    do {
+        boundary.push_back(cur);
+        if(cur.dir == NORTH)
+            area -= cur.pt.x+1;
+        else if(cur.dir == SOUTH)
+            area += cur.pt.x;
+        unsigned char v = gray(im, cur.pt);
+        if(! compare<t>(v, s.gray))
+            s.gray = v;
+        cur.next<t>(im, level);
+    } while(cur != e);
+    return (area<0)? -area: area;
+}
+
+/// Find largest shape \a s with boundary containing \a e. Append this boundary
+/// to \a boundary as a sequence of edgels. \a level is the gray level of the
+/// parent. Fields \c pixels, \c parent, \c sibling and \c child are not set.
+/// Return the area of the shape, enclosed by the boundary.
+static int locate_line(Cimage im, LsShape& s,
+                       Edgel e, int level, std::vector<Edgel>& boundary) {
     s.type = (gray(im,e.pt) < level)? LsShape::INF: LsShape::SUP;
     s.gray = (s.type==LsShape::INF)? 0: 255;
     s.bIgnore = false;
@@ -46,21 +67,9 @@ static std::vector<Edgel> locate_line(Cimage im, LsShape& s,
         fix_initial_edgel(im, s.type, e, level);
         //        e.next(im, s.type, level);
 
-    std::vector<Edgel> boundary;
-    Edgel cur = e;
-    do {
-        boundary.push_back(cur);
-#ifdef BOUNDARY
-        if(cur.dir < DIAGONAL)
-            s.contour.push_back(cur.origin());
-#endif
-        unsigned char v = gray(im, cur.pt);
-        if(! COMPARE(s.type, v, s.gray))
-            s.gray = v;
-        cur.next(im, s.type, level);
-    } while(cur != e);
-
-    return boundary;
+    if(s.type == LsShape::INF)
+        return walk_line<LsShape::INF>(im, s, e, level, boundary);
+    return walk_line<LsShape::SUP>(im, s, e, level, boundary);
 }
 
 /// Add exterior pixel q of edgel \a e to \a Qp if its gray level is \a g,
@@ -68,91 +77,198 @@ static std::vector<Edgel> locate_line(Cimage im, LsShape& s,
 /// discovered (\a color is 0).
 static void classify_exterior(Cimage im, Cimage color,
                               Edgel e, unsigned char g,
-                              std::stack<LsPoint>& Qp,
-                              std::stack<Edgel>& Qc) {
+                              std::vector<LsPoint>& Qp,
+                              std::vector<Edgel>& Qc) {
     Edgel f(e);
     if(!f.inverse(im) || gray(color,f.pt)!=0)
         return;
     if(gray(im,f.pt)==g)
-        Qp.push(f.pt);
+        Qp.push_back(f.pt);
     else
-        Qc.push(f);
+        Qc.push_back(f);
     color->gray[f.pt.y*color->ncol+f.pt.x] = 1;
 }
 
-/// Fill subtree rooted at the last shape of \a tree, with boundary \a bound.
-/// Parameter \a color is a flag marking explored pixels.
-static void locate_all_children(Cimage im, LsTree& tree,
-                                const std::vector<Edgel>& bound,
-                                Cimage color) {
-    LsShape& s = tree.shapes[tree.iNbShapes-1];
-    s.area = 0;
-    if(s.parent) {
-        LsPoint* cEnd=s.parent->pixels;
-        for(LsShape* c=s.child; c!=0; c=c->sibling)
-            if(cEnd<c->pixels+c->area)
-                cEnd = c->pixels+c->area;
-        s.pixels = cEnd;
+/// Push on the stack the shape \a s, whose boundary is at the top of
+/// \c ws.bound from index \a begin. If \a removed is not null, it is the
+/// shape of this boundary instead, a child of \a s not kept in the tree: \a s
+/// gets its private pixels and its children.
+static void push_shape(LsShape& s, size_t begin, LsWorkspace& ws,
+                       const LsShape* removed=0) {
+    if(! removed) {
+        s.area = 0;
+        if(s.parent) { // Pixels are after the ones of previous siblings
+            const LsShape* c = s.sibling; // The last one, complete
+            s.pixels = c? c->pixels+c->area: s.parent->pixels;
+        }
+    }
+    LsWorkspace::PostFrame f;
+    f.s = &s;
+    f.gray = removed? removed->gray: s.gray;
+    f.removed = (removed != 0);
+    f.begin = f.next = begin;
+    f.end = ws.bound.size();
+    f.qp = ws.Qp.size();
+    f.qc = ws.Qc.size();
+    f.pp = ws.pp.size();
+    ws.postFrames.push_back(f);
+}
+
+/// Add to the private pixels of shape \a s, in \c ws.pp, all pixels enclosed
+/// by the boundary at the top of \c ws.bound from index \a begin, whose shape
+/// is not kept in the tree with its subtree.
+static void merge_shape(LsTree& tree, LsShape& s, size_t begin,
+                        LsWorkspace& ws, Cimage color) {
+    sort_crossings(&ws.bound[begin], &ws.bound[0]+ws.bound.size(), tree.ncol,
+                   ws.cross);
+    for(size_t i=0; i<ws.cross.size(); i+=2) {
+        int y = ws.cross[i]/(tree.ncol+1);
+        int x0=ws.cross[i]%(tree.ncol+1), x1=ws.cross[i+1]%(tree.ncol+1);
+        for(LsPoint p={(short int)x0,(short int)y}; p.x<x1; p.x++) {
+            color->gray[y*tree.ncol+p.x] = 2;
+            tree.smallestShape[y*tree.ncol+p.x] = &s;
+            ws.pp.push_back(p);
+        }
     }
-    std::stack<LsPoint> Qp; // Private pixels
-    std::stack<Edgel> Qc; // Edgels for children
-    std::vector<LsPoint> pp; // Private region of s
-    std::vector<Edgel>::const_iterator it=bound.begin(), end=bound.end();
-    for(; it!=end; ++it) {
-        if(tree.smallestShape[it->pt.y*tree.ncol+it->pt.x])
-            continue;
-        if(gray(im,it->pt)==s.gray)
-            Qp.push(it->pt);
-        else
-            Qc.push(*it);
-        color->gray[it->pt.y*color->ncol+it->pt.x] = 1;
-        while(! (Qp.empty() && Qc.empty())) {
-            if(! Qp.empty()) {
-                Edgel e(Qp.top()); Qp.pop();
-                int idx = e.pt.y*color->ncol+e.pt.x;
-                color->gray[idx] = 2;
-                tree.smallestShape[idx] = &s;
-                pp.push_back(e.pt);
-                for(e.dir=0; e.dir!=DIAGONAL; e.dir++) // Scan neighbors
-                    classify_exterior(im, color, e, s.gray, Qp, Qc);
-            }
-            if(! Qc.empty()) {
-                Edgel e(Qc.top()); Qc.pop();
-                if(gray(color,e.pt)==2)
-                    continue;
-                LsShape* c = tree.add_child(s);
-                std::vector<Edgel> b = locate_line(im, *c, e, s.gray);
-                std::vector<Edgel>::const_iterator bc=b.begin(), be=b.end();
-                for(; bc!=be; ++bc) {
-                    color->gray[bc->pt.y*color->ncol+bc->pt.x] = 2;
-                    classify_exterior(im, color, *bc, s.gray, Qp, Qc);
+}
+
+/// Fill subtrees rooted at shapes in \c ws.postFrames. Parameter \a color is
+/// a flag marking explored pixels. The subtrees are explored depth-first with
+/// explicit stacks instead of recursion, as their depth may be large. Only
+/// shapes of area in [\a minArea,\a maxArea] and of gray level differing
+/// by more than \a tolerance from their parent are kept.
+template <int C>
+static void locate_all_children(Cimage im, LsTree& tree, LsWorkspace& ws,
+                                Cimage color, int minArea, int maxArea,
+                                int tolerance) {
+    std::vector<LsWorkspace::PostFrame>& frames = ws.postFrames;
+    while(! frames.empty()) {
+        LsWorkspace::PostFrame& f = frames.back();
+        LsShape& s = *f.s;
+        if(ws.Qp.size()==f.qp && ws.Qc.size()==f.qc) { // Explore from boundary
+            if(f.next == f.end) { // Shape is complete
+                bool removed = f.removed; // Pixels and children are in s
+                if(! removed) {
+                    std::copy(ws.pp.begin()+f.pp, ws.pp.end(),
+                              s.pixels+s.area);
+                    s.area += (int)(ws.pp.size()-f.pp);
+                    ws.pp.resize(f.pp);
                 }
-                locate_all_children(im, tree, b, color);
-                s.area += c->area;
+                ws.bound.erase(ws.bound.begin()+f.begin, ws.bound.end());
+                frames.pop_back();
+                if(!removed && !frames.empty())
+                    frames.back().s->area += s.area;
+                continue;
+            }
+            const Edgel& e = ws.bound[f.next++];
+            if(tree.smallestShape[e.pt.y*tree.ncol+e.pt.x])
+                continue;
+            if(gray(im,e.pt)==f.gray)
+                ws.Qp.push_back(e.pt);
+            else
+                ws.Qc.push_back(e);
+            color->gray[e.pt.y*color->ncol+e.pt.x] = 1;
+        }
+        if(ws.Qp.size() > f.qp) {
+            Edgel e(ws.Qp.back()); ws.Qp.pop_back();
+            int idx = e.pt.y*color->ncol+e.pt.x;
+            color->gray[idx] = 2;
+            tree.smallestShape[idx] = &s;
+            ws.pp.push_back(e.pt);
+            for(e.dir=0; e.dir!=DIAGONAL; e.dir++) // Scan neighbors
+                classify_exterior(im, color, e, (unsigned char)f.gray,
+                                  ws.Qp, ws.Qc);
+        }
+        if(ws.Qc.size() > f.qc) {
+            Edgel e(ws.Qc.back()); ws.Qc.pop_back();
+            if(gray(color,e.pt)==2)
+                continue;
+            LsShape c;
+            size_t b = ws.bound.size();
+            int area = locate_line(im, c, e, f.gray, ws.bound);
+            LsShape* child = 0;
+            if(area < minArea)
+                merge_shape(tree, s, b, ws, color);
+            else if(area<=maxArea &&
+                    (tolerance==0 || abs(c.gray-s.gray)>tolerance)) {
+                child = tree.add_child(s);
+                child->type = c.type;
+                child->gray = c.gray;
+                child->bIgnore = child->bBoundary = false;
+                begin_contour<C>(tree);
             }
+            for(size_t i=b; i<ws.bound.size(); i++) {
+                const Edgel& bc = ws.bound[i];
+                if(child)
+                    add_contour<C>(tree, bc);
+                color->gray[bc.pt.y*color->ncol+bc.pt.x] = 2;
+                classify_exterior(im, color, bc, (unsigned char)f.gray,
+                                  ws.Qp, ws.Qc);
+            }
+            if(child)
+                push_shape(*child, b, ws);
+            else if(area >= minArea)
+                push_shape(s, b, ws, &c);
+            else
+                ws.bound.erase(ws.bound.begin()+b, ws.bound.end());
         }
     }
-    std::copy(pp.begin(), pp.end(), s.pixels+s.area);
-    s.area += (int)pp.size();
+}
+
+/// Extract the tree rooted at \a root, storing level lines according to \a C.
+/// Only shapes of area in [\a minArea,\a maxArea] and of contrast above
+/// \a tolerance are kept, besides the root.
+template <int C>
+static void flst_td_post(Cimage im, LsTree& tree, LsShape& root,
+                         LsWorkspace& ws, Cimage color,
+                         int minArea, int maxArea, int tolerance) {
+    Edgel e(0, 0, SOUTH);
+    locate_line(im, root, e, -1, ws.bound);
+    begin_contour<C>(tree);
+    for(size_t i=0; i<ws.bound.size(); i++)
+        add_contour<C>(tree, ws.bound[i]);
+    push_shape(root, 0, ws);
+    locate_all_children<C>(im, tree, ws, color, minArea, maxArea, tolerance);
 }
 
 /// Top-down post-order FLST algorithm. Children are built immediately on
-/// detection, private pixels are stored after.
-void LsTree::flst_td_post(const unsigned char* gray) {
-    cimage image = {nrow, ncol, (unsigned char*)gray};
+/// detection, private pixels are stored after. Level lines are stored
+/// according to \a options.contour. Only shapes of area in
+/// [\a options.minArea,\a options.maxArea] and of contrast with their parent
+/// above \a options.tolerance are kept, the others are pruned as they are
+/// found. The scratch buffers are taken from \a ws.
+void LsTree::flst_td_post(const unsigned char* gray, const Options& options,
+                          LsWorkspace& ws) {
+    LsImage image = {nrow, ncol, (unsigned char*)gray, false, false};
     int area = ncol * nrow;
 
     std::fill(smallestShape, smallestShape+area, (LsShape*)0);
+    int minArea = options.minArea;
+    int maxArea = (options.maxArea>0)? options.maxArea: area;
+    int tol = options.tolerance;
 
-    cimage color = {nrow, ncol, new unsigned char[area]};
-    std::fill(color.gray, color.gray+area, (unsigned char)0);
+    ws.color.assign(area, 0);
+    LsImage color = {nrow, ncol, &ws.color[0], false, false};
 
     shapes[0].type = LsShape::SUP;
-    shapes[0].pixels = new LsPoint[area];
-    Edgel e(0, 0, SOUTH);
-    std::vector<Edgel> bound = locate_line(&image, shapes[0], e, -1);
-    locate_all_children(&image, *this, bound, &color);
+    switch(options.contour) {
+    case NO_CONTOUR:
+        ::flst_td_post<NO_CONTOUR>(&image, *this, shapes[0], ws, &color,
+                                   minArea, maxArea, tol);
+        break;
+    case CONTOUR_POINTS:
+        ::flst_td_post<CONTOUR_POINTS>(&image, *this, shapes[0], ws, &color,
+                                       minArea, maxArea, tol);
+        break;
+    case CONTOUR_CHAIN:
+        ::flst_td_post<CONTOUR_CHAIN>(&image, *this, shapes[0], ws, &color,
+                                      minArea, maxArea, tol);
+        break;
+    default:
+        ::flst_td_post<CONTOUR_POINTS|CONTOUR_CHAIN>(&image, *this, shapes[0],
+                                                     ws, &color,
+                                                     minArea, maxArea, tol);
+    }
     assert(area == shapes[0].area);
-    delete [] color.gray;
     fill_bBoundary();
 }
@@ -0,0 +1,300 @@
+/**
+ * SPDX-License-Identifier: MPL-2.0+
+ * @file flst_uf.cpp
+ * @brief Bottom-up extraction by union-find of the tree of shapes and of
+ *        component trees
+ * @author Pascal Monasse <monasse@imagine.enpc.fr>
+ *
+ * Copyright (c) 2024 Pascal Monasse
+ * All rights reserved.
+ */
+
+#include "nodes.h"
+#include <algorithm>
+
+/// Image immersed in the cellular grid. The framed image, with one pixel of
+/// value \c m on each side, is first subdivided: a new pixel between two
+/// pixels takes their maximum, and a new pixel between four pixels the larger
+/// of the minima of the two diagonal pairs. The subdivided image is
+/// well-composed, its upper level sets connect the pixels of the image as
+/// 8-connectivity and its lower level sets as 4-connectivity, as in the
+/// top-down algorithms. Its pixels are the faces of even coordinates of the
+/// grid (2-faces), the value of the other faces being the span of the values
+/// of their adjacent 2-faces.
+struct Khalimsky {
+    Khalimsky(Cimage image, unsigned char frame)
+    : im(image), m(frame), w(4*im->ncol+5), h(4*im->nrow+5) {}
+    unsigned char pixel(int i, int j) const;
+    unsigned char value(int X, int Y) const;
+    void span(int f, int& lo, int& hi) const;
+    int face(int x, int y) const { return (4*y+4)*w + 4*x+4; }
+
+    Cimage im; ///< The image
+    unsigned char m; ///< Value of frame
+    int w, h; ///< Dimensions of grid
+};
+
+/// Value of pixel (\a i,\a j) of the framed image.
+inline unsigned char Khalimsky::pixel(int i, int j) const {
+    if(i==0 || j==0 || i>im->ncol || j>im->nrow)
+        return m;
+    return im->gray[(j-1)*im->ncol+i-1];
+}
+
+/// Value of pixel (\a X,\a Y) of the subdivided image.
+inline unsigned char Khalimsky::value(int X, int Y) const {
+    int i=X/2, j=Y/2;
+    if(X%2==0 && Y%2==0)
+        return pixel(i,j);
+    if(Y%2==0)
+        return std::max(pixel(i,j), pixel(i+1,j));
+    if(X%2==0)
+        return std::max(pixel(i,j), pixel(i,j+1));
+    return std::max(std::min(pixel(i,j), pixel(i+1,j+1)),
+                    std::min(pixel(i+1,j), pixel(i,j+1)));
+}
+
+/// Interval [\a lo,\a hi] of values of face \a f.
+inline void Khalimsky::span(int f, int& lo, int& hi) const {
+    int U=f%w, V=f/w;
+    lo = hi = value(U/2,V/2);
+    for(int dy=0; dy<=V%2; dy++)
+        for(int dx=0; dx<=U%2; dx++) {
+            int v = value(U/2+dx,V/2+dy);
+            lo = std::min(lo, v);
+            hi = std::max(hi, v);
+        }
+}
+
+/// Store in \c ws.order the faces of the grid \a k by propagation from the
+/// frame, and their level in \c ws.level. The level of a face is the value of
+/// its interval closest to the current level when it is reached. A level is
+/// exhausted before going to the nearest non-empty one. As a result, a face
+/// comes after all faces of the shapes containing it, except their
+/// descendants.
+static void sort_faces(const Khalimsky& k, LsWorkspace& ws) {
+    int n = k.w*k.h;
+    ws.order.clear();
+    ws.level.assign(n, 0);
+    ws.parent.assign(n, -1); // Flag of faces already queued
+    for(int l=0; l<256; l++)
+        ws.queue[l].clear();
+    int l=k.m, size=1;
+    ws.queue[l].push_back(0);
+    ws.parent[0] = 0;
+    while(size > 0) {
+        for(int d=1; ws.queue[l].empty(); d++) // Nearest non-empty level
+            if(l+d<256 && !ws.queue[l+d].empty())
+                l += d;
+            else if(l-d>=0 && !ws.queue[l-d].empty())
+                l -= d;
+        int f = ws.queue[l].back();
+        ws.queue[l].pop_back();
+        --size;
+        ws.level[f] = (unsigned char)l;
+        ws.order.push_back(f);
+        int x=f%k.w, y=f/k.w;
+        int nb[4] = {f+1, f-k.w, f-1, f+k.w};
+        bool in[4] = {x+1<k.w, y>0, x>0, y+1<k.h};
+        for(int i=0; i<4; i++) {
+            if(! in[i] || ws.parent[nb[i]] >= 0)
+                continue;
+            ws.parent[nb[i]] = 0;
+            int lo, hi;
+            k.span(nb[i], lo, hi);
+            ws.queue[(l<lo)? lo: (l>hi)? hi: l].push_back(nb[i]);
+            ++size;
+        }
+    }
+}
+
+/// Root of \a f in the union-find forest \a zpar, with path compression.
+static int find_root(std::vector<int>& zpar, int f) {
+    int r = f;
+    while(zpar[r] != r)
+        r = zpar[r];
+    while(zpar[f] != r) {
+        int g = zpar[f];
+        zpar[f] = r;
+        f = g;
+    }
+    return r;
+}
+
+/// Build the tree of faces of \a k in \c ws.parent by union-find, processing
+/// faces in reverse order. Each face points to the canonical face of its
+/// component, or to the canonical face of the parent component if it is
+/// itself canonical.
+static void union_find(const Khalimsky& k, LsWorkspace& ws) {
+    std::vector<int>& parent=ws.parent, &zpar=ws.zpar;
+    zpar.assign(k.w*k.h, -1);
+    for(int i=(int)ws.order.size()-1; i>=0; i--) {
+        int f = ws.order[i];
+        parent[f] = zpar[f] = f;
+        int x=f%k.w, y=f/k.w;
+        int nb[4] = {f+1, f-k.w, f-1, f+k.w};
+        bool in[4] = {x+1<k.w, y>0, x>0, y+1<k.h};
+        for(int j=0; j<4; j++) {
+            if(! in[j] || zpar[nb[j]] < 0)
+                continue;
+            int r = find_root(zpar, nb[j]);
+            if(r != f)
+                parent[r] = zpar[r] = f;
+        }
+    }
+    for(size_t i=0; i<ws.order.size(); i++) { // Canonicalize
+        int f=ws.order[i], q=parent[f];
+        if(ws.level[parent[q]] == ws.level[q])
+            parent[f] = parent[q];
+    }
+}
+
+/// Is face \a f canonical, that is the representative of its component?
+inline bool canonical(const LsWorkspace& ws, int f) {
+    return (f==ws.order[0] || ws.level[ws.parent[f]]!=ws.level[f]);
+}
+
+/// Store in \c ws.nodes the components containing pixels of the image, a
+/// parent before its children. Only they give shapes. The parent of other
+/// canonical faces becomes the nearest ancestor component with pixels. The
+/// component of each pixel is stored in \c ws.component.
+static void find_nodes(Cimage im, const Khalimsky& k, LsWorkspace& ws) {
+    const int NONE=-1, KEEP=-2;
+    std::vector<int>& node = ws.zpar; // Index in ws.nodes of canonical faces
+    node.assign(k.w*k.h, NONE);
+    node[ws.order[0]] = KEEP;
+    for(int y=0; y<im->nrow; y++)
+        for(int x=0; x<im->ncol; x++) {
+            int f = k.face(x,y);
+            node[canonical(ws,f)? f: ws.parent[f]] = KEEP;
+        }
+    ws.nodes.clear();
+    for(size_t i=0; i<ws.order.size(); i++) {
+        int f = ws.order[i];
+        if(! canonical(ws, f))
+            continue;
+        int p=ws.parent[f], a=NONE;
+        if(i > 0) {
+            if(node[p] < 0) // Already redirected to a component with pixels
+                p = ws.parent[p];
+            a = node[p];
+        }
+        if(node[f] != KEEP) {
+            ws.parent[f] = p;
+            continue;
+        }
+        LsShape::Type type = (a==NONE || ws.nodes[a].gray<ws.level[f])?
+            LsShape::SUP: LsShape::INF;
+        LsWorkspace::UfNode n = {a, NONE, NONE, 0, 0, ws.level[f], type,
+                                 im->ncol*im->nrow, 0};
+        node[f] = (int)ws.nodes.size();
+        if(a != NONE) {
+            n.sibling = ws.nodes[a].child;
+            ws.nodes[a].child = node[f];
+        }
+        ws.nodes.push_back(n);
+    }
+    ws.component.resize(im->ncol*im->nrow);
+    for(int y=0; y<im->nrow; y++)
+        for(int x=0; x<im->ncol; x++) {
+            int f = k.face(x,y);
+            ws.component[y*im->ncol+x] = node[canonical(ws,f)? f:
+                                                ws.parent[f]];
+        }
+}
+
+/// Store in \c ws.order the pixels of \a im by increasing gray level for a
+/// max-tree (\a type SUP), by decreasing level for a min-tree (INF).
+static void sort_pixels(Cimage im, LsShape::Type type, LsWorkspace& ws) {
+    int n=im->ncol*im->nrow, start[257];
+    unsigned char mask = (type==LsShape::SUP)? 0: 255; // Reverse levels
+    std::fill(start, start+257, 0);
+    for(int i=0; i<n; i++)
+        ++start[(im->gray[i]^mask) + 1];
+    for(int l=0; l<256; l++)
+        start[l+1] += start[l];
+    ws.order.resize(n);
+    for(int i=0; i<n; i++)
+        ws.order[start[im->gray[i]^mask]++] = i;
+}
+
+/// Build the component tree of the level sets of type \a type of \a im in
+/// \c ws.nodes, by union-find of pixels in reverse order of \c ws.order. The
+/// neighbors are given by the connectivity of the type.
+static void union_find_pixels(Cimage im, LsShape::Type type,
+                              LsWorkspace& ws) {
+    static const int dx[8] = {1, 0, -1, 0, 1, -1, -1, 1};
+    static const int dy[8] = {0, -1, 0, 1, -1, -1, 1, 1};
+    std::vector<int>& parent=ws.parent, &zpar=ws.zpar;
+    int w=im->ncol, h=im->nrow, connect=connectivity(type);
+    parent.resize(w*h);
+    zpar.assign(w*h, -1);
+    for(int i=w*h-1; i>=0; i--) {
+        int p=ws.order[i], x=p%w, y=p/w;
+        parent[p] = zpar[p] = p;
+        for(int j=0; j<connect; j++) {
+            int xn=x+dx[j], yn=y+dy[j];
+            if(xn<0 || xn>=w || yn<0 || yn>=h || zpar[yn*w+xn]<0)
+                continue;
+            int r = find_root(zpar, yn*w+xn);
+            if(r != p)
+                parent[r] = zpar[r] = p;
+        }
+    }
+    // Canonicalize and create components, parents first
+    const int NONE=-1;
+    std::vector<int>& node = zpar; // Index in ws.nodes of canonical pixels
+    ws.nodes.clear();
+    ws.component.resize(w*h);
+    for(int i=0; i<w*h; i++) {
+        int p=ws.order[i], q=parent[p];
+        if(im->gray[parent[q]] == im->gray[q])
+            q = parent[p] = parent[q];
+        if(i>0 && im->gray[q]==im->gray[p]) {
+            ws.component[p] = node[q];
+            continue;
+        }
+        LsWorkspace::UfNode n = {(i>0)? node[q]: NONE, NONE, NONE, 0, 0,
+                                 im->gray[p], type, w*h, 0};
+        ws.component[p] = node[p] = (int)ws.nodes.size();
+        if(n.parent != NONE) {
+            n.sibling = ws.nodes[n.parent].child;
+            ws.nodes[n.parent].child = node[p];
+        }
+        ws.nodes.push_back(n);
+    }
+}
+
+/// Bottom-up union-find algorithm. Faces of the image immersed in the cellular
+/// grid are sorted by propagation from the border, then the tree is built by
+/// union-find in reverse order. Level lines are stored according to
+/// \a contour. The scratch buffers are taken from \a ws.
+void LsTree::flst_uf(const unsigned char* gray, int contour, LsWorkspace& ws) {
+    LsImage image = {nrow, ncol, (unsigned char*)gray, false, false};
+    unsigned char m = 255; // Minimum on border, level of the root
+    for(int x=0; x<ncol; x++)
+        m = std::min(m, std::min(gray[x], gray[(nrow-1)*ncol+x]));
+    for(int y=0; y<nrow; y++)
+        m = std::min(m, std::min(gray[y*ncol], gray[y*ncol+ncol-1]));
+    Khalimsky k(&image, m);
+    sort_faces(k, ws);
+    union_find(k, ws);
+    find_nodes(&image, k, ws);
+
+    count_pixels(ws);
+    create_shapes(&image, *this, ws, contour);
+    assert(ncol*nrow == shapes[0].area);
+}
+
+/// Max-tree (\a type SUP) or min-tree (INF) by union-find of pixels sorted by
+/// gray level. Level lines are stored according to \a contour. The scratch
+/// buffers are taken from \a ws.
+void LsTree::component_tree(const unsigned char* gray, LsShape::Type type,
+                            int contour, LsWorkspace& ws) {
+    LsImage image = {nrow, ncol, (unsigned char*)gray, false, false};
+    sort_pixels(&image, type, ws);
+    union_find_pixels(&image, type, ws);
+    count_pixels(ws);
+    create_shapes(&image, *this, ws, contour);
+    assert(ncol*nrow == shapes[0].area);
+}
@@ -0,0 +1,63 @@
+/**
+ * SPDX-License-Identifier: MPL-2.0+
+ * @file grain_FLST.cpp
+ * @brief Grain filter, direct or through the tree.
+ * @author Pascal Monasse <monasse@imagine.enpc.fr>
+ *
+ * Copyright (c) 2024 Pascal Monasse
+ * All rights reserved.
+ */
+
+#include "libImage/image_io.hpp"
+#include "tree.h"
+#include "workspace.h"
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+
+int main(int argc, char* argv[]) {
+    if(argc<3 || argc>4) {
+        std::cerr << "Usage: " << argv[0] << " imageFile minArea [outFile]"
+                  << std::endl;
+        std::cerr << "Remove the shapes of area below minArea, directly and"
+                  << " through the tree" << std::endl;
+        return 1;
+    }
+    Image<unsigned char> im;
+    if(! libs::ReadImage(argv[1], &im)) {
+        std::cerr << "Error loading image " << argv[1] << std::endl;
+        return 1;
+    }
+    int w=im.Width(), h=im.Height(), minArea=atoi(argv[2]);
+
+    Image<unsigned char> out(w, h);
+    LsWorkspace ws;
+    clock_t t = clock();
+    grain_filter(im.data(), w, h, minArea, out.data(), &ws);
+    t = clock()-t;
+    std::cout << "Direct: " << (double)t/CLOCKS_PER_SEC << "s, "
+              << "Peak: " << ws.memory()/1024/1024 << "MB" << std::endl;
+
+    LsTree::Options options;
+    options.contour = LsTree::NO_CONTOUR;
+    t = clock();
+    LsTree tree(im.data(), w, h, LsTree::TD_PRE, options);
+    for(int i=1; i<tree.iNbShapes; i++)
+        tree.shapes[i].bIgnore = (tree.shapes[i].area < minArea);
+    unsigned char* ref = tree.build_image();
+    t = clock()-t;
+    std::cout << "Tree: " << (double)t/CLOCKS_PER_SEC << "s, "
+              << "Peak: " << tree.memPeak/1024/1024 << "MB, "
+              << tree.iNbShapes << " shapes";
+    if(! std::equal(ref, ref+w*h, out.data()))
+        std::cout << " DIFFERENT IMAGE";
+    std::cout << std::endl;
+    delete [] ref;
+
+    if(argc>3 && ! libs::WriteImage(argv[3], out)) {
+        std::cerr << "Error writing image " << argv[3] << std::endl;
+        return 1;
+    }
+    return 0;
+}
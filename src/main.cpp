@@ -16,7 +16,8 @@ using namespace Imagine;
 int main(int argc, char* argv[]) {
     if(argc!=2 && argc!=3) {
         std::cerr << "Usage: " << argv[0] << " imageFile [algo]" << std::endl;
-        std::cerr << "Algo: one of PRE, POST. Default: PRE" << std::endl;
+        std::cerr << "Algo: one of PRE, POST, UF, MAX, MIN, CLASSIC."
+                  << " Default: PRE" << std::endl;
         return 1;
     }
     Image<byte> im;
@@ -28,6 +29,14 @@ int main(int argc, char* argv[]) {
     if(argc>2) {
         if(argv[2]==std::string("POST"))
             algo = LsTree::TD_POST;
+        else if(argv[2]==std::string("UF"))
+            algo = LsTree::UNION_FIND;
+        else if(argv[2]==std::string("MAX"))
+            algo = LsTree::MAX_TREE;
+        else if(argv[2]==std::string("MIN"))
+            algo = LsTree::MIN_TREE;
+        else if(argv[2]==std::string("CLASSIC"))
+            algo = LsTree::CLASSIC;
         else if(argv[2]!=std::string("PRE")) {
             std::cerr << "Unknown algo " << argv[2] << std::endl;
             return 1;
@@ -37,7 +46,9 @@ int main(int argc, char* argv[]) {
     openWindow(im.width()+1, im.height()+1);
     display(im);
 
-    LsTree tree(im.data(), im.width(), im.height(), algo);
+    LsTree::Options options;
+    options.lazy = true; // TD_PRE: shapes extracted when clicked
+    LsTree tree(im.data(), im.width(), im.height(), algo, options);
     std::cout << "Shapes: " << tree.iNbShapes << std::endl;
 
     int x, y;
@@ -48,12 +59,10 @@ int main(int argc, char* argv[]) {
         noRefreshBegin();
         clearWindow();
         display(im);
-#if BOUNDARY
         Color col = (s->type==LsShape::INF) ? BLUE: RED;
-        std::vector<LsPoint>::iterator it, end=s->contour.end();
-        for(it=s->contour.begin(); it!=end; ++it)
+        const LsPoint *it, *end=tree.contour_end(s);
+        for(it=tree.contour_begin(s); it!=end; ++it)
             drawPoint(it->x, it->y, col);
-#endif
         noRefreshEnd();
     }
 
@@ -0,0 +1,147 @@
+/**
+ * SPDX-License-Identifier: MPL-2.0+
+ * @file nodes.h
+ * @brief Shapes of a tree built bottom-up as nodes of the workspace
+ * @author Pascal Monasse <monasse@imagine.enpc.fr>
+ *
+ * Copyright (c) 2024 Pascal Monasse
+ * All rights reserved.
+ */
+
+#ifndef NODES_H
+#define NODES_H
+
+#include "contour.h"
+#include <algorithm>
+
+/// Number of private pixels, area and first pixel in raster order of the
+/// components in \c ws.nodes, knowing the component of each pixel. The root
+/// is the first node, the others may be in any order.
+inline void count_pixels(LsWorkspace& ws) {
+    for(size_t i=0; i<ws.component.size(); i++) {
+        LsWorkspace::UfNode& n = ws.nodes[ws.component[i]];
+        if(n.nPrivate++ == 0)
+            n.first = (int)i;
+    }
+    std::vector<int> &stack=ws.zpar, &pre=ws.order; // Preorder of nodes
+    stack.assign(1, 0);
+    pre.clear();
+    while(! stack.empty()) {
+        int i = stack.back();
+        stack.pop_back();
+        pre.push_back(i);
+        for(int c=ws.nodes[i].child; c>=0; c=ws.nodes[c].sibling)
+            stack.push_back(c);
+    }
+    for(size_t i=pre.size()-1; i>0; i--) {
+        LsWorkspace::UfNode &n=ws.nodes[pre[i]], &p=ws.nodes[n.parent];
+        n.area += n.nPrivate;
+        p.area += n.area;
+        p.first = std::min(p.first, n.first);
+    }
+    ws.nodes[0].area += ws.nodes[0].nPrivate;
+}
+
+/// Store according to \a C the level line of type \a t from edgel \a e,
+/// separating it from pixels beyond \a level.
+template <int C, LsShape::Type t>
+void walk_contour(Cimage im, LsTree& tree, const Edgel& e, int level) {
+    Edgel cur = e;
+    do {
+        add_contour<C>(tree, cur);
+        cur.next<t>(im, level);
+    } while(cur != e);
+}
+
+/// Extract the level line of shape \a s from its first pixel \a p in raster
+/// order, children included, whose upper edgel is on the boundary. The level
+/// line separates \a s from pixels beyond \a level. It is stored according to
+/// \a C.
+template <int C>
+void trace_line(Cimage im, LsTree& tree, const LsShape& s,
+                LsPoint p, int level) {
+    begin_contour<C>(tree);
+    if(C == LsTree::NO_CONTOUR)
+        return;
+    Edgel e(p, WEST);
+    if(s.type == LsShape::INF)
+        walk_contour<C,LsShape::INF>(im, tree, e, level);
+    else
+        walk_contour<C,LsShape::SUP>(im, tree, e, level);
+}
+
+/// Store the level line of node \a i, already traced in \c ws.lines,
+/// according to \a C.
+template <int C>
+void copy_line(LsTree& tree, const LsWorkspace& ws, int i) {
+    begin_contour<C>(tree);
+    for(size_t j=ws.lineStart[i]; j<ws.lineStart[i+1]; j++)
+        add_contour<C>(tree, ws.lines[j]);
+}
+
+/// Create the shapes of \a tree from the components in \c ws.nodes, in
+/// preorder. The private pixels of a shape come before those of its children.
+/// The level line of the root is the border of the image. The level lines of
+/// other shapes are traced, unless already in \c ws.lines.
+template <int C>
+void create_shapes(Cimage im, LsTree& tree, LsWorkspace& ws) {
+    std::vector<int>& stack = ws.zpar;
+    stack.assign(1, 0);
+    LsPoint* pixels = tree.shapes[0].pixels;
+    while(! stack.empty()) {
+        int i = stack.back();
+        LsWorkspace::UfNode& n = ws.nodes[i];
+        stack.pop_back();
+        LsShape* s = n.shape = (n.parent<0)? &tree.shapes[0]:
+            tree.add_child(*ws.nodes[n.parent].shape);
+        s->type = n.type;
+        s->gray = n.gray;
+        s->bIgnore = s->bBoundary = false;
+        s->area = n.area;
+        s->pixels = pixels;
+        pixels += n.nPrivate;
+        int level = (s->type==LsShape::SUP)? n.gray-1: n.gray+1;
+        if(n.parent < 0)
+            level = (s->type==LsShape::SUP)? -1: 256;
+        LsPoint p = {(short int)(n.first%im->ncol),
+                     (short int)(n.first/im->ncol)};
+        if(n.parent>=0 && !ws.lineStart.empty()) // Traced during extraction
+            copy_line<C>(tree, ws, i);
+        else
+            trace_line<C>(im, tree, *s, p, level);
+        n.nPrivate = 0; // Now the number of private pixels stored
+        for(int c=n.child; c>=0; c=ws.nodes[c].sibling)
+            stack.push_back(c);
+    }
+    for(int y=0; y<im->nrow; y++)
+        for(int x=0; x<im->ncol; x++) {
+            int i = y*im->ncol+x;
+            LsWorkspace::UfNode& n = ws.nodes[ws.component[i]];
+            LsPoint p = {(short int)x, (short int)y};
+            n.shape->pixels[n.nPrivate++] = p;
+            tree.smallestShape[i] = n.shape;
+            if(x==0 || y==0 || x+1==im->ncol || y+1==im->nrow)
+                n.shape->bBoundary = true;
+        }
+}
+
+/// Create the shapes, storing level lines according to \a contour.
+inline void create_shapes(Cimage im, LsTree& tree, LsWorkspace& ws,
+                          int contour) {
+    switch(contour) {
+    case LsTree::NO_CONTOUR:
+        create_shapes<LsTree::NO_CONTOUR>(im, tree, ws);
+        break;
+    case LsTree::CONTOUR_POINTS:
+        create_shapes<LsTree::CONTOUR_POINTS>(im, tree, ws);
+        break;
+    case LsTree::CONTOUR_CHAIN:
+        create_shapes<LsTree::CONTOUR_CHAIN>(im, tree, ws);
+        break;
+    default:
+        const int BOTH = LsTree::CONTOUR_POINTS|LsTree::CONTOUR_CHAIN;
+        create_shapes<BOTH>(im, tree, ws);
+    }
+}
+
+#endif
@@ -0,0 +1,97 @@
+/**
+ * SPDX-License-Identifier: MPL-2.0+
+ * @file parallel_FLST.cpp
+ * @brief Scaling of parallel extraction with the number of threads.
+ * @author Pascal Monasse <monasse@imagine.enpc.fr>
+ *
+ * Copyright (c) 2024 Pascal Monasse
+ * All rights reserved.
+ */
+
+#include "libImage/image_io.hpp"
+#include "tree.h"
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/// Wall clock time in seconds.
+static double wall_time() {
+#ifdef _OPENMP
+    return omp_get_wtime();
+#else
+    return (double)clock()/CLOCKS_PER_SEC;
+#endif
+}
+
+/// Are the trees \a t1 and \a t2 identical: shapes, pixels and level lines?
+static bool same(const LsTree& t1, const LsTree& t2) {
+    if(t1.iNbShapes != t2.iNbShapes)
+        return false;
+    const LsPoint *p1=t1.shapes[0].pixels, *p2=t2.shapes[0].pixels;
+    for(int i=0; i<t1.iNbShapes; i++) {
+        const LsShape &s1=t1.shapes[i], &s2=t2.shapes[i];
+        if(s1.type!=s2.type || s1.gray!=s2.gray || s1.area!=s2.area ||
+           s1.bBoundary!=s2.bBoundary || s1.pixels-p1!=s2.pixels-p2 ||
+           (s1.parent? s1.parent-t1.shapes: -1) !=
+           (s2.parent? s2.parent-t2.shapes: -1) ||
+           (s1.child? s1.child-t1.shapes: -1) !=
+           (s2.child? s2.child-t2.shapes: -1) ||
+           (s1.sibling? s1.sibling-t1.shapes: -1) !=
+           (s2.sibling? s2.sibling-t2.shapes: -1))
+            return false;
+    }
+    int n = t1.ncol*t1.nrow;
+    for(int i=0; i<n; i++)
+        if(p1[i].x!=p2[i].x || p1[i].y!=p2[i].y ||
+           t1.smallestShape[i]-t1.shapes != t2.smallestShape[i]-t2.shapes)
+            return false;
+    return (t1.contours.size()==t2.contours.size() &&
+            std::equal(t1.contourStart.begin(), t1.contourStart.end(),
+                       t2.contourStart.begin()) &&
+            (t1.contours.empty() ||
+             memcmp(&t1.contours[0], &t2.contours[0],
+                    t1.contours.size()*sizeof(LsPoint))==0));
+}
+
+int main(int argc, char* argv[]) {
+    if(argc<2) {
+        std::cerr << "Usage: " << argv[0] << " imageFile..." << std::endl;
+        std::cerr << "Time TD_PRE extraction with 1 to all available threads"
+                  << std::endl;
+        return 1;
+    }
+    int nMax = 1;
+#ifdef _OPENMP
+    nMax = omp_get_max_threads();
+#else
+    std::cerr << "Warning: compiled without OpenMP" << std::endl;
+#endif
+    for(int i=1; i<argc; i++) {
+        Image<unsigned char> im;
+        if(! libs::ReadImage(argv[i], &im)) {
+            std::cerr << "Error loading image " << argv[i] << std::endl;
+            return 1;
+        }
+        int w=im.Width(), h=im.Height();
+        LsTree::Options options;
+        double t = wall_time();
+        LsTree ref(im.data(), w, h, LsTree::TD_PRE, options);
+        double t1 = wall_time()-t;
+        std::cout << argv[i] << " (" << w << 'x' << h << ", "
+                  << ref.iNbShapes << " shapes)" << std::endl;
+        std::cout << "  1 thread(s): " << t1 << "s" << std::endl;
+        for(int n=2; n<=nMax; n*=2) {
+            options.nThreads = n;
+            t = wall_time();
+            LsTree tree(im.data(), w, h, LsTree::TD_PRE, options);
+            t = wall_time()-t;
+            std::cout << "  " << n << " thread(s): " << t << "s, speedup "
+                      << t1/t << (same(ref,tree)? "": " DIFFERENT TREE")
+                      << std::endl;
+        }
+    }
+    return 0;
+}
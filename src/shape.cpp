@@ -9,17 +9,31 @@
  */
 
 #include "shape.h"
+#include "tree.h"
 #include <cassert>
 
-/// Return in the subtree of root pShape a shape that is not removed
+/// Return in the subtree of root pShape a shape that is not removed.
+/// The subtree is walked in pre-order through the family pointers, without
+/// recursion, since long chains of removed shapes are common after filtering.
 static LsShape* ls_shape_of_subtree(LsShape* pShape) {
-    LsShape* pShapeNotRemoved = 0;
     if(pShape == 0 || ! pShape->bIgnore)
         return pShape;
-    for(pShape = pShape->child; pShape != 0; pShape = pShape->sibling)
-        if((pShapeNotRemoved = ls_shape_of_subtree(pShape)) != 0)
+    LsShape* pRoot = pShape;
+    pShape = pShape->child;
+    while(pShape != 0) {
+        if(! pShape->bIgnore)
+            return pShape;
+        if(pShape->child) {
+            pShape = pShape->child;
+            continue;
+        }
+        while(pShape != pRoot && pShape->sibling == 0)
+            pShape = pShape->parent;
+        if(pShape == pRoot)
             break;
-    return pShapeNotRemoved;
+        pShape = pShape->sibling;
+    }
+    return 0;
 }
 
 /// To find the true parent, that is the greatest non removed ancestor
@@ -45,13 +59,14 @@ LsShape* LsShape::find_child() {
 /// case the answer should be the null shape) and can still return a shape.
 LsShape* LsShape::find_sibling() {
     LsShape *pShape1 = 0, *pShape2 = 0;
-    // First look at the siblings in the original tree
-    for(pShape1 = sibling; pShape1 != 0; pShape1 = pShape1->sibling)
-        if((pShape2 = ls_shape_of_subtree(pShape1)) != 0)
-            return pShape2;
-    if(parent == 0 || ! parent->bIgnore)
-        return 0; // Parent in original tree is also parent in true tree: done
-    return parent->find_sibling();
+    for(LsShape* pShape = this; ; pShape = pShape->parent) {
+        // First look at the siblings in the original tree
+        for(pShape1 = pShape->sibling; pShape1 != 0; pShape1=pShape1->sibling)
+            if((pShape2 = ls_shape_of_subtree(pShape1)) != 0)
+                return pShape2;
+        if(pShape->parent == 0 || ! pShape->parent->bIgnore)
+            return 0; // Parent in original tree is also parent in true tree
+    }
 }
 
 /// Beware: undefined behavior if the shape is removed (field \c bIgnore).
@@ -69,23 +84,42 @@ LsShape* LsShape::find_prev_sibling() {
     return s;
 }
 
-LsTreeIterator::LsTreeIterator(Order ord, LsShape* shape, bool /*dummy*/)
-: s(shape), o(ord) {}
+/// Iterator at \a shape, without going to the bottom in post-order.
+LsTreeIterator::LsTreeIterator(Order ord, LsShape* shape, LsTree* tree)
+: s(shape), o(ord), t(tree) {}
 
 LsTreeIterator LsTreeIterator::end(Order ord, LsShape* s) {
-    LsTreeIterator it(ord, s, true);
-    if(s && !s->bIgnore) {
-        if(ord == Pre)
-            it.s = uncle(s);
-        else // (ord == Post)
+    return end(LsTreeIterator(ord, s, (LsTree*)0));
+}
+
+/// End of the walk of the subtree of \a s, developing the shapes of \a tree
+/// in lazy mode.
+LsTreeIterator LsTreeIterator::end(Order ord, LsTree& tree, LsShape* s) {
+    return end(LsTreeIterator(ord, s, &tree));
+}
+
+/// End of the walk of the subtree of the shape of iterator \a it.
+LsTreeIterator LsTreeIterator::end(LsTreeIterator it) {
+    if(it.s && !it.s->bIgnore) {
+        if(it.o == Pre)
+            it.s = uncle(it.s);
+        else // (o == Post)
             ++it;
     }
     return it;
 }
 
-LsShape* LsTreeIterator::go_bottom(LsShape* s) {
-    for(LsShape* t = s->find_child(); t; t = s->find_child())
-        s = t;
+/// First child of \a s, extracting the children first in lazy mode. The
+/// siblings of an extracted shape are extracted with it.
+LsShape* LsTreeIterator::find_child(LsShape* s) const {
+    if(t)
+        t->develop(s);
+    return s->find_child();
+}
+
+LsShape* LsTreeIterator::go_bottom(LsShape* s) const {
+    for(LsShape* c = find_child(s); c; c = find_child(s))
+        s = c;
     return s;
 }
 
@@ -99,7 +133,7 @@ LsShape* LsTreeIterator::uncle(LsShape* s) {
 
 LsTreeIterator& LsTreeIterator::operator++() {
     if(o == Pre) {
-        LsShape* sNew = s->find_child();
+        LsShape* sNew = find_child(s);
         s = (sNew == 0)? uncle(s): sNew;
     } else { // (o == Post)
         LsShape* sNew = s->find_sibling();
@@ -10,7 +10,8 @@
 
 #ifndef SHAPE_H
 #define SHAPE_H
-#include <vector>
+
+struct LsTree;
 
 /// Structure for a pixel, 2 coordinates in image plane.
 struct LsPoint {
@@ -30,9 +31,6 @@ struct LsShape {
 
     int area; ///< Number of pixels in the shape
     LsPoint* pixels; ///< Array of pixels in shape
-#ifdef BOUNDARY
-    std::vector<LsPoint> contour; ///< Level line
-#endif
 
     // Tree structure
     LsShape* parent;  ///< Smallest containing shape
@@ -46,31 +44,44 @@ struct LsShape {
     LsShape* find_prev_sibling();
 };
 
-/// To walk the tree in pre- or post-order
+/// To walk the tree in pre- or post-order. In lazy mode (see LsTree::Options),
+/// an iterator given the tree extracts the children of the shapes it reaches
+/// (LsTree::develop), otherwise it visits only the extracted shapes.
 class LsTreeIterator {
 public:
     typedef enum { Pre, Post } Order;
     LsTreeIterator();
     LsTreeIterator(Order ord, LsShape* shape);
+    LsTreeIterator(Order ord, LsTree& tree, LsShape* shape);
 
     LsShape* operator*() const;
     bool operator==(const LsTreeIterator& it) const;
     bool operator!=(const LsTreeIterator& it) const;
     LsTreeIterator& operator++();
     static LsTreeIterator end(Order ord, LsShape* shape);
+    static LsTreeIterator end(Order ord, LsTree& tree, LsShape* shape);
 private:
-    LsTreeIterator(Order ord, LsShape* shape, bool /*dummy*/);
-    static LsShape* go_bottom(LsShape* shape);
+    LsTreeIterator(Order ord, LsShape* shape, LsTree* tree);
+    static LsTreeIterator end(LsTreeIterator it);
+    LsShape* find_child(LsShape* shape) const;
+    LsShape* go_bottom(LsShape* shape) const;
     static LsShape* uncle(LsShape* shape);
     LsShape* s;
     Order o;
+    LsTree* t; ///< Tree in lazy mode, developed by the iterator, or null
 };
 
 inline LsTreeIterator::LsTreeIterator()
-: s(0), o(Pre) {}
+: s(0), o(Pre), t(0) {}
 
 inline LsTreeIterator::LsTreeIterator(Order ord, LsShape* shape)
-: s(shape), o(ord) {
+: s(shape), o(ord), t(0) {
+    if(ord == Post && s && ! s->bIgnore)
+        s = go_bottom(s);
+}
+
+inline LsTreeIterator::LsTreeIterator(Order ord, LsTree& tree, LsShape* shape)
+: s(shape), o(ord), t(&tree) {
     if(ord == Post && s && ! s->bIgnore)
         s = go_bottom(s);
 }
@@ -0,0 +1,52 @@
+/**
+ * SPDX-License-Identifier: MPL-2.0+
+ * @file shape_arrays.cpp
+ * @brief Attributes of shapes as separate arrays (structure of arrays)
+ * @author Pascal Monasse <monasse@imagine.enpc.fr>
+ *
+ * Copyright (c) 2024 Pascal Monasse
+ * All rights reserved.
+ */
+
+#include "shape_arrays.h"
+
+const LsShapeArrays::Id LsShapeArrays::NONE;
+
+/// Constructor.
+LsShapeArrays::LsShapeArrays(const LsTree& tree) {
+    assign(tree);
+}
+
+/// Index of shape \a s in \a tree, NONE for null pointer.
+static LsShapeArrays::Id id(const LsTree& tree, const LsShape* s) {
+    return s? (LsShapeArrays::Id)tree.shape_index(s): LsShapeArrays::NONE;
+}
+
+/// Fill the arrays from the shapes of \a tree, which may be in lazy mode.
+void LsShapeArrays::assign(const LsTree& tree) {
+    size_t n = tree.iNbShapes;
+    type.resize(n);
+    gray.resize(n);
+    area.resize(n);
+    parent.resize(n);
+    child.resize(n);
+    sibling.resize(n);
+    pixels.resize(n);
+    const LsPoint* p = (n>0)? tree.shapes[0].pixels: 0;
+    for(size_t i=0; i<n; i++) {
+        const LsShape& s = *tree.shape((int)i);
+        type[i] = s.type;
+        gray[i] = s.gray;
+        area[i] = s.area;
+        parent[i] = id(tree, s.parent);
+        child[i] = id(tree, s.child);
+        sibling[i] = id(tree, s.sibling);
+        pixels[i] = p? (uint32_t)(s.pixels-p): 0;
+    }
+}
+
+/// Memory (in bytes) used by the arrays.
+size_t LsShapeArrays::memory() const {
+    return type.size()*(2*sizeof(unsigned char) + sizeof(int) +
+                        3*sizeof(Id) + sizeof(uint32_t));
+}
@@ -0,0 +1,37 @@
+/**
+ * SPDX-License-Identifier: MPL-2.0+
+ * @file shape_arrays.h
+ * @brief Attributes of shapes as separate arrays (structure of arrays)
+ * @author Pascal Monasse <monasse@imagine.enpc.fr>
+ *
+ * Copyright (c) 2024 Pascal Monasse
+ * All rights reserved.
+ */
+
+#ifndef SHAPE_ARRAYS_H
+#define SHAPE_ARRAYS_H
+
+#include "tree.h"
+#include <stdint.h>
+
+/// View of the shapes of a tree as one array per attribute. Element \c i of
+/// each array relates to shape \c tree.shapes[i]. Scans touching a few
+/// attributes of all shapes read only these attributes from memory.
+struct LsShapeArrays {
+    typedef uint32_t Id;
+    static const Id NONE = 0xffffffff; ///< Index of no shape
+    LsShapeArrays() {}
+    explicit LsShapeArrays(const LsTree& tree);
+    void assign(const LsTree& tree);
+    size_t memory() const;
+
+    std::vector<unsigned char> type; ///< LsShape::INF or LsShape::SUP
+    std::vector<unsigned char> gray; ///< Gray level of the level set
+    std::vector<int> area; ///< Number of pixels in the shape
+    std::vector<Id> parent; ///< Smallest containing shape
+    std::vector<Id> child; ///< First child
+    std::vector<Id> sibling; ///< Next sibling
+    std::vector<uint32_t> pixels; ///< Index of first pixel in root's pixels
+};
+
+#endif
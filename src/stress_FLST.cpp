@@ -0,0 +1,101 @@
+/**
+ * SPDX-License-Identifier: MPL-2.0+
+ * @file stress_FLST.cpp
+ * @brief Tree extraction on synthetic images yielding very deep trees.
+ * @author Pascal Monasse <monasse@imagine.enpc.fr>
+ *
+ * Copyright (c) 2024 Pascal Monasse
+ * All rights reserved.
+ */
+
+#include "tree.h"
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/// Ramp along the diagonal, the 256 gray levels yield 255 nested shapes.
+static void ramp(unsigned char* im, int w, int h) {
+    for(int y=0; y<h; y++)
+        for(int x=0; x<w; x++)
+            *im++ = (unsigned char)(255*(long)(x+y)/(w+h-2));
+}
+
+/// Concentric squares of alternating black and white, one shape per ring.
+static void rings(unsigned char* im, int w, int h) {
+    for(int y=0; y<h; y++)
+        for(int x=0; x<w; x++) {
+            int dx = std::min(x,w-1-x), dy = std::min(y,h-1-y);
+            *im++ = (std::min(dx,dy)%2)? 255: 0;
+        }
+}
+
+/// Maximum depth of a shape in the tree, the root being at depth 0. The
+/// tree is walked in pre-order through the family links, without recursion,
+/// since the order of shapes in the array depends on the algorithm.
+static int depth(const LsTree& tree) {
+    int d=0, dMax=0;
+    const LsShape* s = tree.shapes;
+    while(s) {
+        if(s->child) {
+            s = s->child;
+            if(dMax < ++d)
+                dMax = d;
+            continue;
+        }
+        for(; s && !s->sibling; --d)
+            s = s->parent;
+        if(s)
+            s = s->sibling;
+    }
+    return dMax;
+}
+
+int main(int argc, char* argv[]) {
+    if(argc>4) {
+        std::cerr << "Usage: " << argv[0] << " [size] [image] [algo]"
+                  << std::endl;
+        std::cerr << "Size: side of square image. Default: 16384" << std::endl;
+        std::cerr << "Image: one of RAMP, RINGS. Default: both" << std::endl;
+        std::cerr << "Algo: one of PRE, POST, UF, MAX, MIN, CLASSIC."
+                  << " Default: all but UF and CLASSIC" << std::endl;
+        return 1;
+    }
+    int n = (argc>1)? atoi(argv[1]): 16384;
+    if(n<2 || n>32767) {
+        std::cerr << "Size should be in [2,32767]" << std::endl;
+        return 1;
+    }
+    std::string image = (argc>2)? argv[2]: "";
+    std::string algo = (argc>3)? argv[3]: "";
+
+    std::vector<unsigned char> im((size_t)n*n);
+    LsTree::Options options;
+    options.contour = LsTree::NO_CONTOUR; // Level lines are too large here
+    const char* names[] = {"RAMP", "RINGS"};
+    const char* algos[] = {"PRE", "POST", "UF", "MAX", "MIN", "CLASSIC"};
+    for(int i=0; i<2; i++) {
+        if(!image.empty() && image!=names[i])
+            continue;
+        (i==0)? ramp(&im[0], n, n): rings(&im[0], n, n);
+        for(int a=LsTree::TD_PRE; a<=LsTree::CLASSIC; a++) {
+            // UNION_FIND only on demand, its grid has 16 times more faces
+            // than there are pixels. CLASSIC too, it grows again the region
+            // of a shape for each ancestor.
+            if(algo.empty()? (a==LsTree::UNION_FIND || a==LsTree::CLASSIC):
+               algo!=algos[a])
+                continue;
+            clock_t t = clock();
+            LsTree tree(&im[0], n, n, (LsTree::Algo)a, options);
+            t = clock()-t;
+            std::cout << names[i] << ' ' << algos[a]
+                      << " Shapes: " << tree.iNbShapes
+                      << " Depth: " << depth(tree)
+                      << " Time: " << (double)t/CLOCKS_PER_SEC << "s"
+                      << " Peak: " << tree.memPeak/1024/1024 << "MB"
+                      << std::endl;
+        }
+    }
+    return 0;
+}
@@ -14,9 +14,22 @@
 #include <iostream>
 
 int main(int argc, char* argv[]) {
-    if(argc!=2 && argc!=3) {
-        std::cerr << "Usage: " << argv[0] << " imageFile [algo]" << std::endl;
-        std::cerr << "Algo: one of PRE, POST. Default: PRE" << std::endl;
+    if(argc<2 || argc>8) {
+        std::cerr << "Usage: " << argv[0] << " imageFile [algo] [contour]"
+                  << " [minArea] [quantum] [tolerance] [maxShapes]"
+                  << std::endl;
+        std::cerr << "Algo: one of PRE, POST, UF, MAX, MIN, CLASSIC."
+                  << " Default: PRE" << std::endl;
+        std::cerr << "Contour: one of NONE, POINTS, CHAIN. Default: POINTS"
+                  << std::endl;
+        std::cerr << "MinArea: minimum area of shapes (PRE, POST, CLASSIC)."
+                  << " Default: 1" << std::endl;
+        std::cerr << "Quantum: step between gray levels of level lines."
+                  << " Default: 1" << std::endl;
+        std::cerr << "Tolerance: maximum contrast of removed shapes"
+                  << " (PRE, POST). Default: 0" << std::endl;
+        std::cerr << "MaxShapes: budget of shapes per step of extraction"
+                  << " (PRE). Default: 0 (none)" << std::endl;
         return 1;
     }
     Image<unsigned char> im;
@@ -28,15 +41,51 @@ int main(int argc, char* argv[]) {
     if(argc>2) {
         if(argv[2]==std::string("POST"))
             algo = LsTree::TD_POST;
+        else if(argv[2]==std::string("UF"))
+            algo = LsTree::UNION_FIND;
+        else if(argv[2]==std::string("MAX"))
+            algo = LsTree::MAX_TREE;
+        else if(argv[2]==std::string("MIN"))
+            algo = LsTree::MIN_TREE;
+        else if(argv[2]==std::string("CLASSIC"))
+            algo = LsTree::CLASSIC;
         else if(argv[2]!=std::string("PRE")) {
             std::cerr << "Unknown algo " << argv[2] << std::endl;
             return 1;
         }
     }
 
-    LsTree tree(im.data(), im.Width(), im.Height(), algo);
+    LsTree::Options options;
+    if(argc>3) {
+        if(argv[3]==std::string("NONE"))
+            options.contour = LsTree::NO_CONTOUR;
+        else if(argv[3]==std::string("CHAIN"))
+            options.contour = LsTree::CONTOUR_CHAIN;
+        else if(argv[3]!=std::string("POINTS")) {
+            std::cerr << "Unknown contour " << argv[3] << std::endl;
+            return 1;
+        }
+    }
+    if(argc>4)
+        options.minArea = atoi(argv[4]);
+    if(argc>5)
+        options.quantum = atoi(argv[5]);
+    if(argc>6)
+        options.tolerance = atoi(argv[6]);
+    if(argc>7)
+        options.maxShapes = atoi(argv[7]);
+
+    LsTree tree(im.data(), im.Width(), im.Height(), algo, options);
+    if(! tree.complete()) {
+        int steps = 1;
+        std::cout << "First step: " << tree.iNbShapes << " shapes. ";
+        while(tree.refine(im.data(), options))
+            ++steps;
+        std::cout << "Steps: " << steps << std::endl;
+    }
     std::cout << "Shapes: " << tree.iNbShapes << " "
-              << "Mem: " << (tree.iNbShapes*sizeof(LsShape)+tree.nrow*tree.ncol*sizeof(LsShape*))/1024/1024 <<  "MB ";
+              << "Mem: " << tree.memory()/1024/1024 <<  "MB "
+              << "Peak: " << tree.memPeak/1024/1024 <<  "MB ";
 
     long int TV=0;
     for(int i=0; i<im.Height(); i++)
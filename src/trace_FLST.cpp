@@ -0,0 +1,125 @@
+/**
+ * SPDX-License-Identifier: MPL-2.0+
+ * @file trace_FLST.cpp
+ * @brief Speed of the tracers of level lines.
+ * @author Pascal Monasse <monasse@imagine.enpc.fr>
+ *
+ * Copyright (c) 2024 Pascal Monasse
+ * All rights reserved.
+ */
+
+#include "tree.h"
+#include "edgel.h"
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/// Uniform noise.
+static void noise(unsigned char* im, int w, int h) {
+    srand(0);
+    for(int i=w*h; i>0; i--)
+        *im++ = (unsigned char)(rand()%256);
+}
+
+/// Smooth waves with small noise, giving long level lines.
+static void smooth(unsigned char* im, int w, int h) {
+    srand(0);
+    for(int y=0; y<h; y++)
+        for(int x=0; x<w; x++)
+            *im++ = (unsigned char)(128 + 100*sin(x*0.01)*cos(y*0.013) +
+                                    rand()%8);
+}
+
+/// Seed edgel of each shape of \a tree but the root: above its first pixel
+/// in raster order, which is not in the shape.
+static std::vector<Edgel> seeds(const LsTree& tree) {
+    std::vector<bool> seen(tree.iNbShapes, false);
+    std::vector<Edgel> e(tree.iNbShapes, Edgel(0, 0, WEST));
+    for(int i=0; i<tree.ncol*tree.nrow; i++)
+        for(LsShape* s=tree.smallestShape[i]; s && !seen[s-tree.shapes];
+            s=s->parent) {
+            seen[s-tree.shapes] = true;
+            e[s-tree.shapes] = Edgel((short int)(i%tree.ncol),
+                                     (short int)(i/tree.ncol), WEST);
+        }
+    return e;
+}
+
+/// Tracers of level lines compared.
+enum Tracer { TYPED, TESTS, TABLE };
+
+/// Follow the level lines of all shapes of \a tree from edgels \a e, with
+/// tracer \a m. Put the number of edgels in \a n and return a checksum of
+/// their sequence.
+static long trace(Cimage im, const LsTree& tree, const std::vector<Edgel>& e,
+                  Tracer m, long& n) {
+    long sum = 0;
+    n = 0;
+    for(int i=1; i<tree.iNbShapes; i++) {
+        const LsShape& s = tree.shapes[i];
+        int level = s.parent->gray, connect = connectivity(s.type);
+        Edgel cur = e[i];
+        do {
+            sum = 31*sum + cur.pt.x + 7*cur.pt.y + 3*cur.dir;
+            ++n;
+            if(m == TYPED)
+                cur.next(im, s.type, level);
+            else if(m == TESTS)
+                cur.next(im, s.type, level, connect);
+            else
+                cur.next_table(im, s.type, level, connect);
+        } while(cur != e[i]);
+    }
+    return sum;
+}
+
+int main(int argc, char* argv[]) {
+    if(argc>3) {
+        std::cerr << "Usage: " << argv[0] << " [size] [image]" << std::endl;
+        std::cerr << "Size: side of square image. Default: 1000" << std::endl;
+        std::cerr << "Image: one of NOISE, SMOOTH. Default: both" << std::endl;
+        return 1;
+    }
+    int n = (argc>1)? atoi(argv[1]): 1000;
+    if(n<2 || n>32767) {
+        std::cerr << "Size should be in [2,32767]" << std::endl;
+        return 1;
+    }
+    std::string image = (argc>2)? argv[2]: "";
+
+    std::vector<unsigned char> im((size_t)n*n);
+    LsTree::Options options;
+    options.contour = LsTree::NO_CONTOUR;
+    const char* names[] = {"NOISE", "SMOOTH"};
+    for(int i=0; i<2; i++) {
+        if(!image.empty() && image!=names[i])
+            continue;
+        (i==0)? noise(&im[0], n, n): smooth(&im[0], n, n);
+        LsTree tree(&im[0], n, n, LsTree::TD_PRE, options);
+        std::vector<Edgel> e = seeds(tree);
+        LsImage c = {n, n, &im[0], false, false};
+        const int N = 3;
+        const char* tracers[N] = {"Typed", "Tests", "Table"};
+        double time[N] = {};
+        long sum[N] = {}, edgels = 0;
+        for(int k=0; k<3*N; k++) { // Best of 3 runs, alternating
+            int m = k%N;
+            clock_t t = clock();
+            sum[m] = trace(&c, tree, e, (Tracer)m, edgels);
+            double dt = (double)(clock()-t)/CLOCKS_PER_SEC;
+            if(k<N || dt<time[m])
+                time[m] = dt;
+        }
+        std::cout << names[i] << " Shapes: " << tree.iNbShapes
+                  << " Edgels: " << edgels;
+        for(int m=0; m<N; m++)
+            std::cout << ' ' << tracers[m] << ": " << edgels/time[m]/1e6
+                      << "M/s";
+        std::cout << ((sum[1]==sum[0] && sum[2]==sum[0])? "": " DIFFERENT")
+                  << std::endl;
+    }
+    return 0;
+}
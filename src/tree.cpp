@@ -9,41 +9,291 @@
  */
 
 #include "tree.h"
+#include "workspace.h"
+#include <algorithm>
 #include <cassert>
 
+/// Number of shapes in the first chunk of storage. Next chunks double the
+/// capacity, until reaching the number of pixels, an upper bound of #shapes.
+static const int MIN_CHUNK = 1024;
+
+/// Size of chunk of shapes starting at shape index \a begin.
+static int chunk_size(int begin, int nPixels) {
+    return std::min(std::max(begin, MIN_CHUNK), nPixels-begin);
+}
+
+/// Put in \a out image \a gray of \a n pixels at the quantized levels of
+/// \a options, through a lookup table.
+static void quantize(const unsigned char* gray, int n,
+                     const LsTree::Options& options,
+                     std::vector<unsigned char>& out) {
+    const std::vector<unsigned char>& levels = options.levels;
+    unsigned char lut[256];
+    size_t t = 0; // Number of thresholds not above v
+    for(int v=0; v<256; v++) {
+        if(levels.empty())
+            lut[v] = (unsigned char)(v/options.quantum*options.quantum);
+        else {
+            while(t<levels.size() && levels[t]<=v)
+                ++t;
+            lut[v] = t? levels[t-1]: 0;
+        }
+    }
+    out.resize(n);
+    for(int i=0; i<n; i++)
+        out[i] = lut[gray[i]];
+}
+
 /// \brief Regular constructor.
-/// \details The tree is built from here, calling the method \a flst_td.
-LsTree::LsTree(const unsigned char* gray, int w, int h, LsTree::Algo algo) {
+/// \details The tree is built from here, calling the method \a extract.
+LsTree::LsTree(const unsigned char* gray, int w, int h, LsTree::Algo algo,
+               const Options& options)
+: ncol(0), nrow(0), shapes(0), iNbShapes(0), smallestShape(0), memPeak(0),
+  iCapacity(0), iShapesCapacity(0), bRecycle(false),
+  nChunks(0), iChunkBegin(0), iChunkEnd(0), lazyWorkspace(0) {
+    extract(gray, w, h, algo, options);
+}
+
+/// Extract the tree of image \a gray of size \a w x \a h.
+/// The buffers of a previous tree are reused if they are large enough.
+void LsTree::extract(const unsigned char* gray, int w, int h,
+                     LsTree::Algo algo, const Options& options) {
+    // Keep buffers of previous tree, if any. In lazy mode, its shapes are in
+    // the chunks.
+    LsShape* buffer = lazyGray.empty()? shapes: 0;
+    LsPoint* pixels = (shapes && iNbShapes>0)? shapes[0].pixels: 0;
+    lazyGray.clear();
+    developed.clear();
+    if(w*h > iCapacity) {
+        delete [] pixels;
+        delete [] smallestShape;
+        free_chunks(); // Too small for new image
+        pixels = new LsPoint[w*h];
+        smallestShape = new LsShape*[w*h];
+        iCapacity = w*h;
+    }
     nrow = h; ncol = w;
+    memPeak = 0;
+    contours.clear();
+    contourStart.clear();
+    chains.clear();
+    pending.clear();
+    pendingStart.clear();
+    nPendingExtracted = 0;
 
-    // Set the root of the tree. #shapes <= #pixels
-    LsShape* pRoot = shapes = new LsShape[nrow*ncol];
+    // Set the root of the tree.
+    iNbShapes = 0;
+    nChunks = iChunkBegin = iChunkEnd = 0;
+    new_chunk();
+    LsShape* pRoot = shapes = chunks[0];
     pRoot->type = LsShape::INF; pRoot->gray = 255;
     pRoot->bBoundary = true;
     pRoot->bIgnore = false;
     pRoot->area = nrow*ncol;
     pRoot->parent = pRoot->sibling = pRoot->child = 0;
-    pRoot->pixels = 0;
+    pRoot->pixels = pixels;
     iNbShapes = 1;
 
-    smallestShape = new LsShape*[ncol*nrow];
     for(int i = ncol*nrow-1; i >= 0; i--)
         smallestShape[i] = pRoot;
 
+    LsWorkspace tmp;
+    LsWorkspace& ws = options.workspace? *options.workspace: tmp;
+    ws.clear();
+    if(options.quantum>1 || !options.levels.empty()) {
+        quantize(gray, w*h, options, ws.quantized);
+        gray = &ws.quantized[0];
+    }
     if(algo == TD_PRE)
-        flst_td_pre(gray);
+        flst_td_pre(gray, options, ws);
     else if(algo == TD_POST)
-        flst_td_post(gray);
+        flst_td_post(gray, options, ws);
+    else if(algo == UNION_FIND)
+        flst_uf(gray, options.contour, ws);
+    else if(algo == MAX_TREE)
+        component_tree(gray, LsShape::SUP, options.contour, ws);
+    else if(algo == MIN_TREE)
+        component_tree(gray, LsShape::INF, options.contour, ws);
+    else if(algo == CLASSIC)
+        flst_classic(gray, options, ws);
     else
         assert(false);
+    if(options.contour & CONTOUR_POINTS) {
+        contourStart.push_back(contours.size()); // End of last level line
+        assert((int)contourStart.size() == iNbShapes+1);
+    }
+    if(options.contour & CONTOUR_CHAIN) {
+        chains.end_lines();
+        assert((int)chains.start.size() == iNbShapes+1);
+    }
+    if(! (algo==TD_PRE && options.lazy)) {
+        compact_shapes(buffer);
+        delete lazyWorkspace;
+        lazyWorkspace = 0;
+        return;
+    }
+    // Lazy mode: shapes stay in the chunks, keep what is needed for develop
+    delete [] buffer;
+    iShapesCapacity = 0;
+    lazyGray.assign(gray, gray+w*h);
+    lazyOptions = options;
+    lazyOptions.workspace = 0;
+    lazyOptions.quantum = 1; // Already applied
+    lazyOptions.levels.clear();
+    if(! lazyWorkspace)
+        lazyWorkspace = new LsWorkspace;
+    developed.assign(iNbShapes, false);
+    developed[0] = true;
+    memPeak = std::max(memPeak, memory());
+}
+
+/// Continue the budgeted extraction of the tree of image \a gray, see
+/// Options::maxShapes, with the budget of \a options. The other options must
+/// be the ones of the extraction, except for level lines, which are stored as
+/// in the tree. Return the number of new shapes, 0 if the tree is complete.
+/// A tree in lazy mode leaves it.
+int LsTree::refine(const unsigned char* gray, const Options& options) {
+    if(complete())
+        return 0;
+    if(! lazyGray.empty())
+        leave_lazy();
+    LsWorkspace tmp;
+    LsWorkspace& ws = options.workspace? *options.workspace: tmp;
+    ws.clear();
+    if(options.quantum>1 || !options.levels.empty()) {
+        quantize(gray, ncol*nrow, options, ws.quantized);
+        gray = &ws.quantized[0];
+    }
+    Options o = options;
+    o.lazy = false;
+    return resume(gray, o, 0, -1, ws);
+}
+
+/// Leave lazy mode: the children not extracted go back to a heap, for the
+/// budgeted extraction, and the shapes leave the chunks for an array.
+void LsTree::leave_lazy() {
+    size_t n = 0;
+    for(size_t i=0; i<pending.size(); i++)
+        if(pending[i].parent && !developed[shape_index(pending[i].parent)])
+            pending[n++] = pending[i];
+    pending.resize(n);
+    std::make_heap(pending.begin(), pending.end());
+    pendingStart.clear();
+    nPendingExtracted = 0;
+    compact_shapes(0);
+    lazyGray.clear();
+    developed.clear();
+    delete lazyWorkspace;
+    lazyWorkspace = 0;
+}
+
+/// Extract the children of shape \a s not extracted yet, in lazy mode (see
+/// Options::lazy). Links of shapes see only extracted shapes.
+void LsTree::develop(LsShape* s) {
+    develop(s, -1);
+}
+
+/// Extract the children of shape \a s not extracted yet, in lazy mode, and
+/// if \a pixel is not negative, those of its shapes containing the pixel,
+/// down to its smallest shape, in a single pass. The scratch buffers are the
+/// workspace of the tree.
+void LsTree::develop(LsShape* s, int pixel) {
+    if(lazyGray.empty() || developed[shape_index(s)])
+        return;
+    resume(&lazyGray[0], lazyOptions, s, pixel, *lazyWorkspace);
+    developed.resize(iNbShapes, false);
+    developed[shape_index(s)] = true;
+    if(pixel >= 0)
+        for(LsShape* t=smallestShape[pixel]; t!=s; t=t->parent)
+            developed[shape_index(t)] = true;
+}
+
+/// Shape of index \a i. In lazy mode, shapes are in chunks of storage of
+/// increasing size, not in a single array.
+LsShape* LsTree::shape(int i) const {
+    if(lazyGray.empty())
+        return shapes+i;
+    int begin = 0;
+    for(int c=0; c<nChunks; c++) {
+        int n = chunk_size(begin, nrow*ncol);
+        if(i < begin+n)
+            return chunks[c] + (i-begin);
+        begin += n;
+    }
+    assert(false);
+    return 0;
+}
+
+/// Index of shape \a s, see \c shape.
+int LsTree::shape_index(const LsShape* s) const {
+    if(lazyGray.empty())
+        return (int)(s-shapes);
+    int begin = 0;
+    for(int c=0; c<nChunks; c++) {
+        int n = chunk_size(begin, nrow*ncol);
+        if(chunks[c] <= s && s < chunks[c]+n)
+            return begin + (int)(s-chunks[c]);
+        begin += n;
+    }
+    assert(false);
+    return -1;
+}
+
+/// Extract children not extracted yet of image \a gray, according to
+/// \a options, \a s and \a pixel, see \c expand. The new shapes are put
+/// after the existing ones: in lazy mode, in the chunks, where shapes never
+/// move; otherwise in a new array. Level lines are stored as in the tree.
+/// Return the number of new shapes.
+int LsTree::resume(const unsigned char* gray, const Options& options,
+                   LsShape* s, int pixel, LsWorkspace& ws) {
+    if(complete())
+        return 0;
+    Options o = options;
+    o.contour = (contourStart.empty()? 0: CONTOUR_POINTS) |
+        (chains.start.empty()? 0: CONTOUR_CHAIN);
+    if(o.contour & CONTOUR_POINTS)
+        contourStart.pop_back();
+    if(o.contour & CONTOUR_CHAIN)
+        chains.start.pop_back();
+
+    int nOld = iNbShapes;
+    if(! o.lazy) { // New shapes are in chunks, numbered after the existing ones
+        free_chunks();
+        iChunkBegin = iChunkEnd = iNbShapes;
+    }
+    int n = expand(gray, o, s, pixel, ws);
+    if(o.contour & CONTOUR_POINTS)
+        contourStart.push_back(contours.size());
+    if(o.contour & CONTOUR_CHAIN)
+        chains.end_lines();
+    if(n==0 || o.lazy)
+        return n;
+
+    for(int i=0; i<nOld; i++)
+        order.push_back(shapes+i);
+    int i = nOld;
+    for(int c=0; c<nChunks; c++) {
+        int m = chunk_size(i, nrow*ncol);
+        for(int j=0; j<m && i+j<iNbShapes; j++)
+            order.push_back(&chunks[c][j]);
+        i += m;
+    }
+    LsShape* old = shapes;
+    compact_shapes_in_order(new LsShape[iNbShapes]);
+    delete [] old;
+    iShapesCapacity = iNbShapes;
+    return n;
 }
 
 /// Destructor.
 LsTree::~LsTree() {
     if(shapes && iNbShapes > 0)
         delete [] shapes[0].pixels;
-    delete [] shapes;
+    if(lazyGray.empty()) // Otherwise, the first chunk
+        delete [] shapes;
     delete [] smallestShape;
+    free_chunks();
+    delete lazyWorkspace;
 }
 
 /// Reconstruct an image from the tree
@@ -60,9 +310,13 @@ unsigned char* LsTree::build_image() const {
     return gray;
 }
 
-/// Smallest non-removed shape at pixel (\a x,\a y).
+/// Smallest non-removed shape at pixel (\a x,\a y). In lazy mode, the
+/// shapes containing the pixel are extracted first, see \c develop.
 LsShape* LsTree::smallest_shape(int x, int y) {
-    LsShape* pShape = smallestShape[y*ncol + x];
+    int i = y*ncol + x;
+    if(! lazyGray.empty())
+        develop(smallestShape[i], i);
+    LsShape* pShape = smallestShape[i];
     if(pShape->bIgnore)
         pShape = pShape->find_parent();
     return pShape;
@@ -70,23 +324,180 @@ LsShape* LsTree::smallest_shape(int x, int y) {
 
 /// Add a new child to shape \a parent.
 /// Fields other than family pointers are left uninitialized.
-/// No allocation is performed, the new shape is placed at shapes[iNbShapes],
-/// hence after the call the returned shape is simply shapes[iNbShapes-1].
+/// The new shape is taken from the last chunk of storage, a new chunk being
+/// allocated when it is full. Shapes never move during extraction.
 LsShape* LsTree::add_child(LsShape& parent) {
-    assert(iNbShapes < nrow*ncol);
+    if(iNbShapes == iChunkEnd)
+        new_chunk();
     LsShape* old = parent.child;
-    parent.child = &shapes[iNbShapes++];
+    parent.child = &chunks[nChunks-1][iNbShapes++ - iChunkBegin];
     parent.child->parent = &parent;
     parent.child->sibling = old;
     parent.child->child = 0;
     return parent.child;
 }
 
-/// Index \a smallestShapeRecursive from tree rooted at \a s.
+/// First point of the level line of shape \a s. If level lines are not
+/// stored (option CONTOUR_POINTS), it is the same as \c contour_end.
+const LsPoint* LsTree::contour_begin(const LsShape* s) const {
+    if(contourStart.empty()) // Not extracted
+        return 0;
+    return &contours[0] + contourStart[shape_index(s)];
+}
+
+/// Past the last point of the level line of shape \a s.
+const LsPoint* LsTree::contour_end(const LsShape* s) const {
+    if(contourStart.empty()) // Not extracted
+        return 0;
+    return &contours[0] + contourStart[shape_index(s)+1];
+}
+
+/// Iterator on the first point of the level line of shape \a s. If chain
+/// codes are not stored (option CONTOUR_CHAIN), it is equal to \c chain_end.
+LsChainIterator LsTree::chain_begin(const LsShape* s) const {
+    if(chains.start.empty()) { // Not extracted
+        LsPoint p = {0,0};
+        return LsChainIterator(0, 0, p);
+    }
+    return chains.begin(shape_index(s));
+}
+
+/// Iterator past the last point of the level line of shape \a s.
+LsChainIterator LsTree::chain_end(const LsShape* s) const {
+    if(chains.start.empty()) // Not extracted
+        return chain_begin(s);
+    return chains.end(shape_index(s));
+}
+
+/// Memory (in bytes) used by the tree: shapes, pixels, \c smallestShape,
+/// level lines and children not extracted. In lazy mode, the chunks of shapes
+/// and the workspace are counted.
+size_t LsTree::memory() const {
+    size_t mem = (lazyGray.empty()? iNbShapes: iChunkEnd)*sizeof(LsShape);
+    mem += contours.capacity()*sizeof(LsPoint) +
+        contourStart.capacity()*sizeof(size_t) + chains.memory() +
+        pending.capacity()*sizeof(Pending) +
+        pendingStart.capacity()*sizeof(size_t) + lazyGray.capacity() +
+        developed.capacity()/8;
+    if(lazyWorkspace)
+        mem += lazyWorkspace->memory();
+    if(smallestShape)
+        mem += nrow*ncol*sizeof(LsShape*);
+    if(shapes && iNbShapes > 0 && shapes[0].pixels)
+        mem += nrow*ncol*sizeof(LsPoint);
+    return mem;
+}
+
+/// Free all chunks of shapes, used or spare.
+void LsTree::free_chunks() {
+    for(size_t c=0; c<chunks.size(); c++)
+        delete [] chunks[c];
+    chunks.clear();
+    nChunks = 0;
+}
+
+/// Allocate a new chunk of shapes, doubling the capacity of storage.
+/// A chunk is allocated for an image of \c iCapacity pixels, so that a spare
+/// chunk, kept from a previous extraction, is large enough to be used instead.
+void LsTree::new_chunk() {
+    int n = chunk_size(iChunkEnd, nrow*ncol);
+    assert(n > 0);
+    if(nChunks == (int)chunks.size())
+        chunks.push_back(new LsShape[chunk_size(iChunkEnd, iCapacity)]);
+    ++nChunks;
+    iChunkBegin = iChunkEnd;
+    iChunkEnd += n;
+    // The pixels and smallestShape arrays are allocated anyway
+    size_t mem = iChunkEnd*sizeof(LsShape) +
+        nrow*ncol*(sizeof(LsPoint)+sizeof(LsShape*));
+    mem += contours.capacity()*sizeof(LsPoint) +
+        contourStart.capacity()*sizeof(size_t) + chains.memory();
+    memPeak = std::max(memPeak, mem);
+}
+
+/// Move the shapes from the chunks to an array of exactly \c iNbShapes shapes
+/// and update all pointers to shapes, in the tree and in \c smallestShape.
+/// The array is \a buffer, of capacity \c iShapesCapacity, if large enough.
+void LsTree::compact_shapes(LsShape* buffer) {
+    LsShape* s = buffer;
+    if(iNbShapes > iShapesCapacity) {
+        delete [] buffer;
+        s = new LsShape[iNbShapes];
+        iShapesCapacity = iNbShapes;
+    }
+    memPeak = std::max(memPeak, memory() + iChunkEnd*sizeof(LsShape));
+    if(! order.empty()) {
+        compact_shapes_in_order(s);
+        return;
+    }
+    int i = 0;
+    for(int c=0; c<nChunks; c++) {
+        int n = chunk_size(i, nrow*ncol);
+        for(int j=0; j<n && i+j<iNbShapes; j++)
+            s[i+j] = chunks[c][j];
+        i += n;
+    }
+    // Old shapes are now useless, their field area stores their new index
+    i = 0;
+    for(int c=0; c<nChunks; c++) {
+        int n = chunk_size(i, nrow*ncol);
+        for(int j=0; j<n && i+j<iNbShapes; j++)
+            chunks[c][j].area = i+j;
+        i += n;
+    }
+    for(i=0; i<iNbShapes; i++) {
+        if(s[i].parent)  s[i].parent  = s + s[i].parent->area;
+        if(s[i].sibling) s[i].sibling = s + s[i].sibling->area;
+        if(s[i].child)   s[i].child   = s + s[i].child->area;
+    }
+    for(i=nrow*ncol-1; i>=0; i--)
+        smallestShape[i] = s + smallestShape[i]->area;
+    for(size_t j=0; j<pending.size(); j++)
+        if(pending[j].parent) // Root extracted in lazy mode
+            pending[j].parent = s + pending[j].parent->area;
+
+    if(! bRecycle)
+        free_chunks();
+    iChunkBegin = iChunkEnd = iNbShapes;
+    shapes = s;
+}
+
+/// Move the shapes to array \a s, in the sequence \c order instead of the
+/// order of creation. The links of children and siblings are rebuilt, so that
+/// children are in reverse order, as built by \c add_child.
+void LsTree::compact_shapes_in_order(LsShape* s) {
+    assert((int)order.size() == iNbShapes);
+    for(int i=0; i<iNbShapes; i++)
+        s[i] = *order[i];
+    // Old shapes are now useless, their field area stores their new index
+    for(int i=0; i<iNbShapes; i++)
+        order[i]->area = i;
+    for(int i=0; i<iNbShapes; i++) {
+        if(s[i].parent)  s[i].parent  = s + s[i].parent->area;
+        s[i].child = 0;
+    }
+    for(int i=1; i<iNbShapes; i++) {
+        s[i].sibling = s[i].parent->child;
+        s[i].parent->child = s+i;
+    }
+    for(int i=nrow*ncol-1; i>=0; i--)
+        smallestShape[i] = s + smallestShape[i]->area;
+    for(size_t i=0; i<pending.size(); i++)
+        pending[i].parent = s + pending[i].parent->area;
+
+    for(size_t b=0; b<taskBlocks.size(); b++)
+        delete [] taskBlocks[b];
+    taskBlocks.clear();
+    order.clear();
+    if(! bRecycle)
+        free_chunks();
+    iChunkBegin = iChunkEnd = iNbShapes;
+    shapes = s;
+}
+
+/// Index in \a smallestShape the private pixels of shape \a s.
 static void index(LsShape* s, LsShape** smallestShape, int w) {
-    for(LsShape* c=s->child; c; c=c->sibling)
-        index(c, smallestShape, w);
-    // Fill private pixels, located either before or after all children's pixels
+    // Private pixels are located either before or after all children's pixels
     LsPoint *cBegin=s->pixels+s->area, *cEnd=s->pixels;
     for(LsShape* c=s->child; c; c=c->sibling) {
         if(cBegin>c->pixels)
@@ -101,10 +512,26 @@ static void index(LsShape* s, LsShape** smallestShape, int w) {
 }
 
 /// Fill the index tree.smallestShape (supposed to be already allocated) based
-/// on the field \c pixels of each shape.
+/// on the field \c pixels of each shape. Private pixels of shapes are
+/// disjoint, so that shapes can be handled in array order, without descending
+/// the tree.
 void LsTree::index_smallestShape() {
     assert(smallestShape!=0);
-    index(shapes, smallestShape, ncol);
+    for(int i=0; i<iNbShapes; i++)
+        index(shapes+i, smallestShape, ncol);
+}
+
+/// Set field \c bBoundary of the smallest shapes of the pixels of the border of
+/// the image, those whose private pixels meet the border in the extraction.
+void LsTree::mark_border() {
+    for(int x=0; x<ncol; x++) {
+        smallestShape[x]->bBoundary = true;
+        smallestShape[(nrow-1)*ncol+x]->bBoundary = true;
+    }
+    for(int y=1; y+1<nrow; y++) {
+        smallestShape[y*ncol]->bBoundary = true;
+        smallestShape[(y+1)*ncol-1]->bBoundary = true;
+    }
 }
 
 /// Tag shapes meeting image boundary (use \c smallestShape, field \c bBoundary)
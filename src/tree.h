@@ -12,29 +12,206 @@
 #define TREE_H
 
 #include "shape.h"
+#include "chain_code.h"
+#include <cstddef>
+#include <vector>
+
+struct LsKeep;
+struct LsWorkspace;
+struct LsImage;
 
 /// Tree of shapes.
 struct LsTree {
-    typedef enum {TD_PRE, TD_POST} Algo;
-    LsTree() {} //For use with old FLST only
-    LsTree(const unsigned char* gray, int w, int h, Algo algo=TD_PRE);
+    /// Extraction algorithm. MAX_TREE and MIN_TREE do not give the tree of
+    /// shapes but the component tree of upper or lower level sets. CLASSIC
+    /// is the original FLST, growing regions from local extrema.
+    /// UNION_FIND works in a cellular grid of about 16 faces per pixel: the
+    /// image is subdivided once so that its level sets have the connectivity
+    /// of the other algorithms, then immersed in the grid. Its scratch
+    /// buffers take about 260 bytes per pixel (260MB for 1000x1000), and it
+    /// is several times slower than TD_PRE: it is not meant for large images.
+    typedef enum {TD_PRE, TD_POST, UNION_FIND, MAX_TREE, MIN_TREE,
+                  CLASSIC} Algo;
+    /// Storage of level lines, flags to combine
+    typedef enum {NO_CONTOUR=0, CONTOUR_POINTS=1, CONTOUR_CHAIN=2} Contour;
+    /// Options of extraction
+    struct Options {
+        Options()
+        : contour(CONTOUR_POINTS), workspace(0), nThreads(1), minArea(1),
+          maxArea(0), tolerance(0), quantum(1), maxShapes(0), maxTime(0),
+          lazy(false), padded(false), runs(false) {}
+        int contour; ///< Combination of \c Contour flags
+        /// Scratch buffers to reuse across extractions, 0 for temporary ones
+        LsWorkspace* workspace;
+        /// Threads extracting subtrees in parallel (TD_PRE with OpenMP only),
+        /// 0 for all available. The tree is the same for any number.
+        int nThreads;
+        /// Range of area of shapes in the tree, 0 for no maximum (TD_PRE,
+        /// TD_POST and CLASSIC). The pixels of other shapes go to their
+        /// nearest ancestor in the tree.
+        int minArea, maxArea;
+        /// Maximum difference of gray level between a shape and its parent
+        /// for the shape to be removed, 0 for none (TD_PRE and TD_POST). Its
+        /// private pixels go to its parent, which adopts its children.
+        int tolerance;
+        /// Gray levels of level lines: the multiples of \c quantum, or the
+        /// thresholds in \c levels, in increasing order, if not empty. Each
+        /// pixel takes the greatest threshold not above its gray level, 0 if
+        /// there is none. Default: all levels. The quantized image is a copy in
+        /// the workspace.
+        int quantum;
+        std::vector<unsigned char> levels; ///< Thresholds, see \c quantum
+        /// Budget of extraction, 0 for none (TD_PRE only): number of shapes
+        /// and elapsed time in seconds, on the wall clock of
+        /// std::chrono::steady_clock, not the processor time. Shapes are
+        /// extracted by decreasing area and the pixels of children not
+        /// extracted yet are private pixels of their parent, until a call to
+        /// \c refine. Sequential extraction.
+        int maxShapes;
+        double maxTime;
+        /// Extract only the root and its children (TD_PRE only). The children
+        /// of a shape are extracted when \c smallest_shape or an iterator
+        /// given the tree reaches it, or by \c develop. The tree keeps a copy
+        /// of the image and a workspace. Its shapes stay in the chunks of
+        /// storage of the extraction, so that they never move: \c shapes is
+        /// only the first chunk, see \c shape and \c shape_index, through
+        /// which LsShapeArrays and LsCompactTree convert the tree. Links of
+        /// shapes see only the extracted shapes.
+        bool lazy;
+        /// Extract in a copy of the image with a frame of one pixel, which
+        /// saves bounds checks in the walk of level lines and the filling of
+        /// private areas (TD_PRE only, not with a budget or in lazy mode).
+        /// It takes about 10 bytes per pixel of scratch memory.
+        bool padded;
+        /// Explore private areas by runs of pixels of flat zones in rows
+        /// rather than pixel by pixel, which is faster on images with large
+        /// constant regions (TD_PRE only, same restrictions as \c padded). The
+        /// tree is the same, up to the order of shapes and pixels.
+        bool runs;
+    };
+
+    LsTree() //For use with old FLST or LsTreeBuilder only
+    : ncol(0), nrow(0), shapes(0), iNbShapes(0), smallestShape(0), memPeak(0),
+      iCapacity(0), iShapesCapacity(0), bRecycle(false),
+      nChunks(0), iChunkBegin(0), iChunkEnd(0), nPendingExtracted(0),
+      lazyWorkspace(0) {}
+    LsTree(const unsigned char* gray, int w, int h, Algo algo=TD_PRE,
+           const Options& options=Options());
     ~LsTree();
 
+    int refine(const unsigned char* gray, const Options& options=Options());
+    /// Are all shapes extracted, the budget being sufficient?
+    bool complete() const { return pending.size() == nPendingExtracted; }
+    void develop(LsShape* s);
+    LsShape* shape(int i) const;
+    int shape_index(const LsShape* s) const;
     unsigned char* build_image() const;
     LsShape* smallest_shape(int x, int y);
     LsShape* add_child(LsShape& parent);
+    size_t memory() const;
+    const LsPoint* contour_begin(const LsShape* s) const;
+    const LsPoint* contour_end(const LsShape* s) const;
+    LsChainIterator chain_begin(const LsShape* s) const;
+    LsChainIterator chain_end(const LsShape* s) const;
 
     int ncol, nrow; ///< Dimensions of image
-    LsShape* shapes; ///< The array of shapes
+    LsShape* shapes; ///< The array of shapes, the first chunk in lazy mode
     int iNbShapes; ///< The number of shapes
 
     /// For each pixel, the smallest shape containing it
     LsShape** smallestShape;
+    size_t memPeak; ///< Peak memory (bytes) used during extraction
+
+    /// Level lines of all shapes, in the order of shapes (CONTOUR_POINTS)
+    std::vector<LsPoint> contours;
+    /// For each shape, index of first point of its level line in \c contours.
+    /// An additional last element is the total number of points.
+    std::vector<size_t> contourStart;
+    /// Level lines as chain codes, in the order of shapes (CONTOUR_CHAIN)
+    LsChainCodes chains;
 private:
+    friend class LsTreeBuilder;
+    int iCapacity; ///< Number of pixels that fit in allocated buffers
+    int iShapesCapacity; ///< Number of shapes that fit in array \c shapes
+    bool bRecycle; ///< Keep chunks for next extraction (LsTreeBuilder)
+    std::vector<LsShape*> chunks; ///< Growable storage during extraction
+    int nChunks; ///< Number of chunks in use, the next ones are spare
+    int iChunkBegin; ///< Index of first shape in last chunk
+    int iChunkEnd; ///< Number of shapes that fit in allocated chunks
+    /// Shapes in tree order, if not the order of creation (parallel TD_PRE)
+    std::vector<LsShape*> order;
+    /// Storage of shapes extracted by parallel tasks
+    std::vector<LsShape*> taskBlocks;
+    /// Child not extracted in budgeted or lazy mode, its edgel \c pt, \c dir on
+    /// its boundary. Its pixels are reserved from index \c offset.
+    struct Pending {
+        LsShape* parent; ///< Parent shape, 0 for the root
+        LsPoint pt; ///< Interior pixel of edgel
+        unsigned char dir; ///< Direction of edgel
+        bool merged; ///< Are its pixels private pixels of its parent?
+        int area; ///< Number of pixels
+        int offset; ///< Index of first pixel in the array of pixels
+        bool operator<(const Pending& p) const
+        { return (area<p.area || (area==p.area && offset<p.offset)); }
+    };
+    /// Heap of children not extracted. In lazy mode, all children instead,
+    /// those of each shape being contiguous, in the order of shapes.
+    std::vector<Pending> pending;
+    std::vector<size_t> pendingStart; ///< Lazy: first child of each shape
+    size_t nPendingExtracted; ///< Lazy: number of children extracted
+    std::vector<unsigned char> lazyGray; ///< Image, empty if not lazy mode
+    Options lazyOptions; ///< Options of extraction in lazy mode
+    LsWorkspace* lazyWorkspace; ///< Scratch buffers in lazy mode
+    std::vector<bool> developed; ///< Shapes with all children extracted
+    void extract(const unsigned char* gray, int w, int h, Algo algo,
+                 const Options& options);
+    void free_chunks();
+    void new_chunk();
+    void compact_shapes(LsShape* buffer);
+    void compact_shapes_in_order(LsShape* s);
     void index_smallestShape();
     void fill_bBoundary();
-    void flst_td_pre(const unsigned char* gray); ///< Top-down pre-order algo
-    void flst_td_post(const unsigned char* gray); ///< Top-down post-order algo
+    void mark_border();
+    /// Extraction in budgeted or lazy mode
+    void develop(LsShape* s, int pixel);
+    void leave_lazy();
+    int resume(const unsigned char* gray, const Options& options, LsShape* s,
+               int pixel, LsWorkspace& ws);
+    int expand(const unsigned char* gray, const Options& options, LsShape* s,
+               int pixel, LsWorkspace& ws);
+    template <int C>
+    int expand(LsImage* im, LsWorkspace& ws, const LsKeep& keep,
+               const Options& options, LsShape* s, int pixel);
+    template <int C>
+    int expand_budget(LsImage* im, LsWorkspace& ws, const LsKeep& keep,
+                      int maxShapes, double maxTime);
+    template <int C>
+    int develop(LsImage* im, LsWorkspace& ws, const LsKeep& keep, LsShape* s);
+    template <int C>
+    void extract_pending(LsImage* im, const Pending& p, LsWorkspace& ws,
+                         const LsKeep& keep, bool lazy);
+    void merge_pending(LsImage* im, LsWorkspace& ws, size_t begin);
+    /// Top-down pre-order algo
+    void flst_td_pre(const unsigned char* gray, const Options& options,
+                     LsWorkspace& ws);
+    template <int C>
+    void flst_td_pre(LsImage* im, LsWorkspace& ws, int nThreads,
+                     const LsKeep& keep);
+    /// Top-down post-order algo
+    void flst_td_post(const unsigned char* gray, const Options& options,
+                      LsWorkspace& ws);
+    /// Bottom-up union-find algo
+    void flst_uf(const unsigned char* gray, int contour, LsWorkspace& ws);
+    /// Max-tree or min-tree by union-find
+    void component_tree(const unsigned char* gray, LsShape::Type type,
+                        int contour, LsWorkspace& ws);
+    /// Classical FLST from local extrema
+    void flst_classic(const unsigned char* gray, const Options& options,
+                      LsWorkspace& ws);
 };
 
+/// Grain filter: image of the tree without the shapes of area below minArea.
+void grain_filter(const unsigned char* gray, int w, int h, int minArea,
+                  unsigned char* out, LsWorkspace* workspace=0);
+
 #endif
@@ -0,0 +1,28 @@
+/**
+ * SPDX-License-Identifier: MPL-2.0+
+ * @file tree_builder.cpp
+ * @brief Extraction of trees of successive images, recycling memory
+ * @author Pascal Monasse <monasse@imagine.enpc.fr>
+ *
+ * Copyright (c) 2024 Pascal Monasse
+ * All rights reserved.
+ */
+
+#include "tree_builder.h"
+
+/// Constructor.
+LsTreeBuilder::LsTreeBuilder() {
+    t.bRecycle = true;
+}
+
+/// Extract the tree of image \a gray of size \a w x \a h, replacing the tree
+/// of the previous image. If \a options do not give a workspace, the one of
+/// the builder is used.
+const LsTree& LsTreeBuilder::build(const unsigned char* gray, int w, int h,
+                                   LsTree::Algo algo, LsTree::Options options) {
+    if(! options.workspace)
+        options.workspace = &ws;
+    t.extract(gray, w, h, algo, options);
+    return t;
+}
+
@@ -0,0 +1,37 @@
+/**
+ * SPDX-License-Identifier: MPL-2.0+
+ * @file tree_builder.h
+ * @brief Extraction of trees of successive images, recycling memory
+ * @author Pascal Monasse <monasse@imagine.enpc.fr>
+ *
+ * Copyright (c) 2024 Pascal Monasse
+ * All rights reserved.
+ */
+
+#ifndef TREE_BUILDER_H
+#define TREE_BUILDER_H
+
+#include "tree.h"
+#include "workspace.h"
+
+/// Extract the trees of successive images, typically frames of a video.
+/// The builder owns a tree, rebuilt for each new image in the buffers of the
+/// previous one (shapes, pixels, smallestShape, level lines) and with a
+/// persistent workspace. Buffers are reallocated only when an image has more
+/// pixels than all previous ones or more shapes than fit in the array.
+class LsTreeBuilder {
+public:
+    LsTreeBuilder();
+    const LsTree& build(const unsigned char* gray, int w, int h,
+                        LsTree::Algo algo=LsTree::TD_PRE,
+                        LsTree::Options options=LsTree::Options());
+    /// Tree of the last image. It is modified by the next call to \c build.
+    LsTree& tree() { return t; }
+private:
+    LsTree t; ///< The last tree
+    LsWorkspace ws; ///< Scratch buffers of extraction
+    LsTreeBuilder(const LsTreeBuilder&); // Not copyable
+    void operator=(const LsTreeBuilder&);
+};
+
+#endif
@@ -0,0 +1,185 @@
+/**
+ * SPDX-License-Identifier: MPL-2.0+
+ * @file workspace.h
+ * @brief Scratch buffers of tree extraction, reusable across images
+ * @author Pascal Monasse <monasse@imagine.enpc.fr>
+ *
+ * Copyright (c) 2024 Pascal Monasse
+ * All rights reserved.
+ */
+
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include "edgel.h"
+#include <cstddef>
+#include <vector>
+
+/// Scratch buffers of the extraction algorithms. They are emptied at the end
+/// of an extraction but keep their capacity, so that an extraction given a
+/// workspace already used (LsTree::Options::workspace) does not allocate
+/// memory for them, except for growing to a larger image or deeper tree.
+struct LsWorkspace {
+    /// Shape under construction in TD_PRE, whose children are built.
+    /// Its seed edgels are seeds[next..end).
+    struct PreFrame {
+        LsShape* s; ///< The shape
+        size_t begin; ///< Index of first seed edgel of children
+        size_t next; ///< Index of seed edgel of next child to build
+        size_t end; ///< Past the index of last seed edgel
+        size_t line; ///< Size of seedLines before the boundaries of children
+    };
+    /// Shape under construction in TD_POST. Its boundary is bound[next..end).
+    /// Its stacks of pixels and edgels to explore are the elements of Qp and
+    /// Qc above indices \c qp and \c qc, its private pixels found so far are
+    /// the elements of pp from index \c pp. A shape removed from the tree, of
+    /// area above the maximum or of contrast within the tolerance, has a frame
+    /// with its gray level and the shape of its parent, which gets its private
+    /// pixels and its children.
+    struct PostFrame {
+        LsShape* s; ///< The shape
+        int gray; ///< Gray level of private pixels
+        bool removed; ///< Is the shape a removed child of \c s?
+        size_t begin; ///< Index of first boundary edgel
+        size_t next; ///< Index of next boundary edgel to explore
+        size_t end; ///< Past the index of last boundary edgel
+        size_t qp, qc, pp; ///< Bottom of stacks of the shape
+    };
+
+    /// Component with pixels in a tree built bottom-up (UNION_FIND, MAX_TREE,
+    /// MIN_TREE, CLASSIC), giving a shape.
+    struct UfNode {
+        int parent; ///< Index of parent component, -1 for root
+        int child; ///< Index of a child component, -1 for none
+        int sibling; ///< Index of next sibling component, -1 for none
+        int nPrivate; ///< Number of private pixels
+        int area; ///< Number of pixels
+        unsigned char gray; ///< Gray level
+        LsShape::Type type; ///< Type of level set
+        int first; ///< Index of first pixel in raster order
+        LsShape* shape; ///< The shape in the tree
+    };
+
+    /// Configuration of the frontier of the region of CLASSIC at a pixel:
+    /// directions of separation with its upper and left neighbors.
+    struct Frontier {
+        int exploration; ///< Last exploration having set the directions
+        unsigned char directions; ///< Combination of directions
+    };
+    /// Neighbor pixel of the region of CLASSIC, linked to the next one at the
+    /// same gray level.
+    struct Neighbor {
+        LsPoint point; ///< The pixel
+        int next; ///< Index of next neighbor at same level
+    };
+
+    void clear();
+    size_t memory() const;
+
+    /// Image at quantized levels (LsTree::Options::quantum or levels)
+    std::vector<unsigned char> quantized;
+
+    // TD_PRE
+    std::vector<PreFrame> preFrames; ///< Shapes under construction
+    std::vector<Edgel> seeds; ///< Seeds of children of shapes in preFrames
+    std::vector<int> seedArea; ///< Area of each child, known from boundary
+    std::vector<unsigned char> seedGray; ///< Gray level of each child
+    /// Boundaries of children, each closed by its first edgel again, so that
+    /// their extraction does not walk them again
+    std::vector<Edgel> seedLines;
+    std::vector<size_t> seedLine; ///< Index in seedLines of each child
+    /// Only its address is used: it marks in the index of shapes of pixels
+    /// the boundary of the shape being initialized, before the exploration
+    /// of its private area, see \c is_free in flst.cpp
+    LsShape mark;
+    /// Image with a frame, a copy per type of level set, see padded_gray
+    std::vector<unsigned char> padded;
+
+    // TD_POST
+    std::vector<PostFrame> postFrames; ///< Shapes under construction
+    /// Boundaries of shapes in postFrames, or of a pruned child in TD_PRE
+    std::vector<Edgel> bound;
+    std::vector<LsPoint> Qp; ///< Private pixels to explore
+    std::vector<Edgel> Qc; ///< Edgels for children
+    std::vector<LsPoint> pp; ///< Private region
+    std::vector<unsigned char> color; ///< Flag of explored pixels
+
+    // TD_PRE and TD_POST with area range
+    std::vector<int> cross; ///< Vertical edgels of a pruned shape, by rows
+
+    // Grain filter and TD_PRE with padded image
+    std::vector<LsShape*> index; ///< Shape of each pixel, as smallestShape
+    std::vector<LsPoint> grain; ///< Private pixels of current shape
+
+    // UNION_FIND
+    std::vector<int> order; ///< Faces in order of propagation from border
+    std::vector<unsigned char> level; ///< Level of faces
+    std::vector<int> parent; ///< Parent of faces
+    std::vector<int> zpar; ///< Union-find forest
+    std::vector<int> queue[256]; ///< Hierarchical queue of propagation
+    std::vector<UfNode> nodes; ///< Components with pixels
+    std::vector<int> component; ///< Index in nodes of pixels
+
+    // CLASSIC
+    std::vector<unsigned char> image; ///< Image flattened as shapes are found
+    std::vector<int> visited; ///< Last exploration with pixel in region
+    std::vector<int> neighbor; ///< Last exploration with pixel as neighbor
+    std::vector<Frontier> frontier; ///< Frontier of region at pixels
+    std::vector<Neighbor> neighbors; ///< Neighbors of region
+    std::vector<int> freeNeighbors; ///< Free places in neighbors
+    std::vector<LsPoint> region; ///< Pixels of region
+    std::vector<unsigned char> mask; ///< Pixels of region set to 1
+    std::vector<Edgel> lines; ///< Level lines of nodes
+    std::vector<size_t> lineStart; ///< Index of first edgel of nodes in lines
+};
+
+/// Empty the buffers, keeping their capacity.
+inline void LsWorkspace::clear() {
+    preFrames.clear();
+    seeds.clear();
+    seedArea.clear();
+    seedGray.clear();
+    seedLines.clear();
+    seedLine.clear();
+    postFrames.clear();
+    bound.clear();
+    Qp.clear();
+    Qc.clear();
+    pp.clear();
+    order.clear();
+    nodes.clear();
+    lines.clear();
+    lineStart.clear();
+    for(int l=0; l<256; l++)
+        queue[l].clear();
+}
+
+/// Memory (in bytes) reserved by the buffers.
+inline size_t LsWorkspace::memory() const {
+    size_t mem = quantized.capacity() +
+        preFrames.capacity()*sizeof(PreFrame) +
+        seeds.capacity()*sizeof(Edgel) + seedArea.capacity()*sizeof(int) +
+        seedGray.capacity() + seedLines.capacity()*sizeof(Edgel) +
+        seedLine.capacity()*sizeof(size_t) + padded.capacity() +
+        postFrames.capacity()*sizeof(PostFrame) +
+        bound.capacity()*sizeof(Edgel) +
+        Qp.capacity()*sizeof(LsPoint) + Qc.capacity()*sizeof(Edgel) +
+        pp.capacity()*sizeof(LsPoint) + color.capacity() +
+        cross.capacity()*sizeof(int) +
+        index.capacity()*sizeof(LsShape*) + grain.capacity()*sizeof(LsPoint) +
+        order.capacity()*sizeof(int) + level.capacity() +
+        parent.capacity()*sizeof(int) + zpar.capacity()*sizeof(int) +
+        nodes.capacity()*sizeof(UfNode) + component.capacity()*sizeof(int) +
+        image.capacity() + visited.capacity()*sizeof(int) +
+        neighbor.capacity()*sizeof(int) +
+        frontier.capacity()*sizeof(Frontier) +
+        neighbors.capacity()*sizeof(Neighbor) +
+        freeNeighbors.capacity()*sizeof(int) +
+        region.capacity()*sizeof(LsPoint) + mask.capacity() +
+        lines.capacity()*sizeof(Edgel) + lineStart.capacity()*sizeof(size_t);
+    for(int l=0; l<256; l++)
+        mem += queue[l].capacity()*sizeof(int);
+    return mem;
+}
+
+#endif